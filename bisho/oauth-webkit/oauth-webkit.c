@@ -61,6 +61,7 @@ struct _BishoPaneOauthWebkitPrivate {
 typedef enum {
   LOGGED_OUT,
   WORKING,
+  STORING,
   CONTINUE_AUTH_10,
   CONTINUE_AUTH_10a,
   LOGGED_IN,
@@ -209,6 +210,39 @@ log_out_clicked (GtkButton *button, gpointer user_data)
                                  NULL);
 }
 
+static void
+grant_access_cb (GnomeKeyringResult result, gpointer user_data)
+{
+  BishoPaneOauthWebkit *pane = BISHO_PANE_OAUTH_WEBKIT (user_data);
+  ServiceInfo *info = BISHO_PANE (pane)->info;
+  SwClientService *service;
+
+  if (result != GNOME_KEYRING_RESULT_OK)
+    g_message ("Cannot grant access to the keyring: %s", gnome_keyring_result_to_message (result));
+
+  update_widgets (pane, LOGGED_IN);
+  service = sw_client_get_service (BISHO_PANE (pane)->socialweb, info->name);
+  sw_client_service_credentials_updated (service);
+}
+
+static void
+item_created_cb (GnomeKeyringResult result, guint32 id, gpointer user_data)
+{
+  BishoPaneOauthWebkit *pane = BISHO_PANE_OAUTH_WEBKIT (user_data);
+
+  if (result == GNOME_KEYRING_RESULT_OK) {
+    gnome_keyring_item_grant_access_rights (NULL,
+                                            "libsocialweb",
+                                            LIBEXECDIR "/libsocialweb-core",
+                                            id, GNOME_KEYRING_ACCESS_READ,
+                                            grant_access_cb,
+                                            g_object_ref (pane), g_object_unref);
+  } else {
+    g_message ("Cannot update keyring: %s", gnome_keyring_result_to_message (result));
+    update_widgets (pane, LOGGED_OUT);
+  }
+}
+
 static void
 access_token_cb (OAuthProxy   *proxy,
                  const GError *error,
@@ -218,8 +252,8 @@ access_token_cb (OAuthProxy   *proxy,
   BishoPaneOauthWebkit *pane = BISHO_PANE_OAUTH_WEBKIT (user_data);
   ServiceInfo *info = BISHO_PANE (pane)->info;
   BishoPaneOauthWebkitPrivate *priv = pane->priv;
+  GnomeKeyringAttributeList *attrs;
   char *encoded;
-  SwClientService *service;
 
   if (error) {
     update_widgets (pane, LOGGED_OUT);
@@ -232,32 +266,22 @@ access_token_cb (OAuthProxy   *proxy,
     (oauth_proxy_get_token (OAUTH_PROXY (priv->proxy)),
      oauth_proxy_get_token_secret (OAUTH_PROXY (priv->proxy)));
 
-  /* TODO async */
-  GnomeKeyringResult result;
-  GnomeKeyringAttributeList *attrs;
-  guint32 id;
   attrs = gnome_keyring_attribute_list_new ();
   gnome_keyring_attribute_list_append_string (attrs, "server", priv->base_url);
   gnome_keyring_attribute_list_append_string (attrs, "consumer-key", priv->consumer_key);
 
-  result = gnome_keyring_item_create_sync (NULL,
-                                           GNOME_KEYRING_ITEM_GENERIC_SECRET,
-                                           info->display_name,
-                                           attrs, encoded,
-                                           TRUE, &id);
+  update_widgets (pane, STORING);
 
-  if (result == GNOME_KEYRING_RESULT_OK) {
-    gnome_keyring_item_grant_access_rights_sync (NULL,
-                                                 "libsocialweb",
-                                                 LIBEXECDIR "/libsocialweb-core",
-                                                 id, GNOME_KEYRING_ACCESS_READ);
-    update_widgets (pane, LOGGED_IN);
-    service = sw_client_get_service (BISHO_PANE (pane)->socialweb, info->name);
-    sw_client_service_credentials_updated (service);
-  } else {
-    g_message ("Cannot update keyring: %s", gnome_keyring_result_to_message (result));
-    update_widgets (pane, LOGGED_OUT);
-  }
+  gnome_keyring_item_create (NULL,
+                             GNOME_KEYRING_ITEM_GENERIC_SECRET,
+                             info->display_name,
+                             attrs, encoded,
+                             TRUE,
+                             item_created_cb,
+                             g_object_ref (pane), g_object_unref);
+
+  gnome_keyring_attribute_list_free (attrs);
+  g_free (encoded);
 }
 
 static void
@@ -352,6 +376,10 @@ update_widgets (BishoPaneOauthWebkit *pane, ButtonState state)
     bisho_pane_set_banner (BISHO_PANE (pane), _("Connecting..."));
     gtk_widget_hide (priv->button);
     break;
+  case STORING:
+    bisho_pane_set_banner (BISHO_PANE (pane), _("Saving your login details..."));
+    gtk_widget_hide (priv->button);
+    break;
   case CONTINUE_AUTH_10:
     {
       char *s;
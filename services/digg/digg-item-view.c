@@ -18,6 +18,7 @@
  * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+
 #include <config.h>
 #include <time.h>
 #include <stdlib.h>
@@ -28,138 +29,30 @@
 #include <libsocialweb/sw-utils.h>
 #include <libsocialweb/sw-item.h>
 #include <libsocialweb-keyfob/sw-keyfob.h>
-#include <libsocialweb/sw-cache.h>
 
 #include <rest/rest-proxy.h>
-#include <rest/rest-xml-parser.h>
 #include <libsoup/soup.h>
 #include "utils.h"
 
 #include "digg-item-view.h"
 #include "digg.h"
 
-G_DEFINE_TYPE (SwDiggItemView, sw_digg_item_view, SW_TYPE_ITEM_VIEW)
-
-#define GET_PRIVATE(o) \
-  (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_DIGG_ITEM_VIEW, SwDiggItemViewPrivate))
+G_DEFINE_TYPE (SwDiggItemView, sw_digg_item_view, SW_TYPE_POLL_ITEM_VIEW)
 
-typedef struct _SwDiggItemViewPrivate SwDiggItemViewPrivate;
+#define TOP_NEWS "2.0/story.getTopNews"
 
-struct _SwDiggItemViewPrivate {
-  RestProxy *proxy;
-  guint timeout_id;
-  GHashTable *params;
-  gchar *query;
+static const PollItemViewInfo digg_info = {
+  .name = "digg",
+  .endpoint = TOP_NEWS,
+  .default_page_size = 10,
+  .max_page_size = 100,
+  .max_pages = 10,
+  .count_param = "limit",
+  .page_param = "offset",
+  .paging = POLL_PAGING_INDEX,
+  .first_page = 0
 };
 
-enum
-{
-  PROP_0,
-  PROP_PROXY,
-  PROP_PARAMS,
-  PROP_QUERY
-};
-
-
-#define UPDATE_TIMEOUT 5 * 60
-
-static void _service_item_hidden_cb (SwService   *service,
-                                     const gchar *uid,
-                                     SwItemView  *item_view);
-static void _service_user_changed_cb (SwService  *service,
-                                      SwItemView *item_view);
-static void _service_capabilities_changed_cb (SwService    *service,
-                                              const gchar **caps,
-                                              SwItemView   *item_view);
-
-static void
-sw_digg_item_view_get_property (GObject    *object,
-                                  guint       property_id,
-                                  GValue     *value,
-                                  GParamSpec *pspec)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (object);
-
-  switch (property_id) {
-    case PROP_PROXY:
-      g_value_set_object (value, priv->proxy);
-      break;
-    case PROP_PARAMS:
-      g_value_set_boxed (value, priv->params);
-      break;
-    case PROP_QUERY:
-      g_value_set_string (value, priv->query);
-      break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
-  }
-}
-
-static void
-sw_digg_item_view_set_property (GObject      *object,
-                                  guint         property_id,
-                                  const GValue *value,
-                                  GParamSpec   *pspec)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (object);
-
-  switch (property_id) {
-    case PROP_PROXY:
-      priv->proxy = g_value_dup_object (value);
-      break;
-    case PROP_PARAMS:
-      priv->params = g_value_dup_boxed (value);
-      break;
-    case PROP_QUERY:
-      priv->query = g_value_dup_string (value);
-      break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
-  }
-}
-
-static void
-sw_digg_item_view_dispose (GObject *object)
-{
-  SwItemView *item_view = SW_ITEM_VIEW (object);
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (object);
-
-  if (priv->proxy)
-  {
-    g_object_unref (priv->proxy);
-    priv->proxy = NULL;
-  }
-
-  if (priv->timeout_id)
-  {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
-  }
-
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_item_hidden_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_user_changed_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_capabilities_changed_cb,
-                                        item_view);
-
-  G_OBJECT_CLASS (sw_digg_item_view_parent_class)->dispose (object);
-}
-
-static void
-sw_digg_item_view_finalize (GObject *object)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (object);
-
-  g_free (priv->query);
-  g_hash_table_unref (priv->params);
-
-  G_OBJECT_CLASS (sw_digg_item_view_parent_class)->finalize (object);
-}
-
 static SwItem *
 make_item (SwService *service, JsonNode *entry)
 {
@@ -227,30 +120,21 @@ make_item (SwService *service, JsonNode *entry)
   return item;
 }
 
-static void
-_got_diggs_cb (RestProxyCall *call,
-               const GError  *error,
-               GObject       *weak_object,
-               gpointer       userdata)
+static gint
+digg_item_view_parse_page (SwPollItemView *view,
+                           RestProxyCall  *call,
+                           const char     *endpoint)
 {
-  SwItemView *item_view = SW_ITEM_VIEW (weak_object);
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (item_view);
   SwService *service;
-  SwSet *set;
-
   JsonNode *root, *node;
   JsonArray *stories_array;
   JsonObject *object;
   guint i, length;
 
-  if (error) {
-    g_message ("Error: %s", error->message);
-    return;
-  }
-
   root = json_node_from_call (call, "Digg");
   if (!root)
-    return;
+    return -1;
+  sw_poll_item_view_mark_parsed (view);
 
   /*
   stories : [
@@ -305,235 +189,45 @@ _got_diggs_cb (RestProxyCall *call,
   */
 
   object = json_node_get_object (root);
-  if (!json_object_has_member (object, "stories"))
-    return; 
+  if (!json_object_has_member (object, "stories")) {
+    json_node_free (root);
+    return -1;
+  }
 
-  set = sw_item_set_new ();
   node = json_object_get_member (object, "stories");
 
   stories_array = json_node_get_array (node);
   length = json_array_get_length (stories_array);
 
-  service = sw_item_view_get_service (SW_ITEM_VIEW (item_view));
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
 
   for (i=0; i<length; i++) {
     JsonNode *entry = json_array_get_element (stories_array, i);
-    SwItem *item;
-
-    item = make_item (service, entry);
-
-    if (!sw_service_is_uid_banned (service, sw_item_get (item, "id")))
-      sw_set_add (set, (GObject *)item);
-
-    g_object_unref (item);
-  }
-
-  g_object_unref (call);
-
-  sw_item_view_set_from_set (item_view, set);
-  sw_cache_save (service,
-                 priv->query,
-                 priv->params,
-                 set);
-
-  sw_set_unref (set);
-}
-
-static void
-_get_status_updates (SwDiggItemView *item_view)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (item_view);
-  RestProxyCall *call;
-
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_function (call, "2.0/story.getTopNews");
+    const char *id;
 
-  rest_proxy_call_add_params (call,
-                              "limit", "10",
-                              NULL);
-  rest_proxy_call_async (call, _got_diggs_cb, (GObject *)item_view, NULL, NULL);
-}
-
-static gboolean
-_update_timeout_cb (gpointer data)
-{
-  SwDiggItemView *item_view = SW_DIGG_ITEM_VIEW (data);
-
-  _get_status_updates (item_view);
+    id = json_object_get_string_member (json_node_get_object (entry),
+                                        "story_id");
+    if (sw_poll_item_view_is_banned (view, "digg-", id))
+      continue;
 
-  return TRUE;
-}
-
-static void
-_load_from_cache (SwDiggItemView *item_view)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set;
-
-  set = sw_cache_load (sw_item_view_get_service (SW_ITEM_VIEW (item_view)),
-                       priv->query,
-                       priv->params);
-
-  if (set)
-  {
-    sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                               set);
-    sw_set_unref (set);
+    sw_poll_item_view_add_item (view, make_item (service, entry));
   }
-}
-
-static void
-digg_item_view_start (SwItemView *item_view)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View already started.");
-  } else {
-    priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                              (GSourceFunc)_update_timeout_cb,
-                                              item_view);
-    _load_from_cache ((SwDiggItemView *)item_view);
-    _get_status_updates ((SwDiggItemView *)item_view);
-  }
-}
-
-static void
-digg_item_view_stop (SwItemView *item_view)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (!priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View not running");
-  } else {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
-  }
-}
-
-static void
-digg_item_view_refresh (SwItemView *item_view)
-{
-  _get_status_updates ((SwDiggItemView *)item_view);
-}
 
-static void
-_service_item_hidden_cb (SwService   *service,
-                         const gchar *uid,
-                         SwItemView  *item_view)
-{
-  sw_item_view_remove_by_uid (item_view, uid);
-}
+  json_node_free (root);
 
-static void
-_service_user_changed_cb (SwService  *service,
-                          SwItemView *item_view)
-{
-  SwSet *set;
-
-  /* We need to empty the set */
-  set = sw_item_set_new ();
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                             set);
-  sw_set_unref (set);
-
-  /* And drop the cache */
-  sw_cache_drop_all (service);
-}
-
-static void
-_service_capabilities_changed_cb (SwService    *service,
-                                  const gchar **caps,
-                                  SwItemView   *item_view)
-{
-  SwDiggItemViewPrivate *priv = GET_PRIVATE ((SwDiggItemView*) item_view);
-
-  if (sw_service_has_cap (caps, CREDENTIALS_VALID))
-  {
-    digg_item_view_refresh (item_view);
-
-    if (!priv->timeout_id)
-    {
-      priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                                (GSourceFunc)_update_timeout_cb,
-                                                item_view);
-    }
-  } else {
-    if (priv->timeout_id)
-    {
-      g_source_remove (priv->timeout_id);
-      priv->timeout_id = 0;
-    }
-  }
-}
-
-static void
-sw_digg_item_view_constructed (GObject *object)
-{
-  SwItemView *item_view = SW_ITEM_VIEW (object);
-
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "item-hidden",
-                    (GCallback)_service_item_hidden_cb,
-                    item_view);
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "user-changed",
-                    (GCallback)_service_user_changed_cb,
-                    item_view);
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "capabilities-changed",
-                    (GCallback)_service_capabilities_changed_cb,
-                    item_view);
-
-  if (G_OBJECT_CLASS (sw_digg_item_view_parent_class)->constructed)
-    G_OBJECT_CLASS (sw_digg_item_view_parent_class)->constructed (object);
+  return length;
 }
 
 static void
 sw_digg_item_view_class_init (SwDiggItemViewClass *klass)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  SwItemViewClass *item_view_class = SW_ITEM_VIEW_CLASS (klass);
-  GParamSpec *pspec;
-
-  g_type_class_add_private (klass, sizeof (SwDiggItemViewPrivate));
-
-  object_class->get_property = sw_digg_item_view_get_property;
-  object_class->set_property = sw_digg_item_view_set_property;
-  object_class->dispose = sw_digg_item_view_dispose;
-  object_class->finalize = sw_digg_item_view_finalize;
-  object_class->constructed = sw_digg_item_view_constructed;
-
-  item_view_class->start = digg_item_view_start;
-  item_view_class->stop = digg_item_view_stop;
-  item_view_class->refresh = digg_item_view_refresh;
-
-  pspec = g_param_spec_object ("proxy",
-                               "proxy",
-                               "proxy",
-                               REST_TYPE_PROXY,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PROXY, pspec);
-
-  pspec = g_param_spec_boxed ("params",
-                              "params",
-                              "params",
-                              G_TYPE_HASH_TABLE,
-                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PARAMS, pspec);
-
-  pspec = g_param_spec_string ("query",
-                               "query",
-                               "query",
-                               NULL,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_QUERY, pspec);
+  SwPollItemViewClass *poll_class = SW_POLL_ITEM_VIEW_CLASS (klass);
+
+  poll_class->info = &digg_info;
+  poll_class->parse_page = digg_item_view_parse_page;
 }
 
 static void
 sw_digg_item_view_init (SwDiggItemView *self)
 {
 }
-
@@ -22,7 +22,7 @@
 #define _SW_DIGG_ITEM_VIEW
 
 #include <glib-object.h>
-#include <libsocialweb/sw-item-view.h>
+#include "poll-item-view.h"
 
 G_BEGIN_DECLS
 
@@ -44,11 +44,11 @@ G_BEGIN_DECLS
   (G_TYPE_INSTANCE_GET_CLASS ((obj), SW_TYPE_DIGG_ITEM_VIEW, SwDiggItemViewClass))
 
 typedef struct {
-  SwItemView parent;
+  SwPollItemView parent;
 } SwDiggItemView;
 
 typedef struct {
-  SwItemViewClass parent_class;
+  SwPollItemViewClass parent_class;
 } SwDiggItemViewClass;
 
 GType sw_digg_item_view_get_type (void);
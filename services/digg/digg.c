@@ -42,6 +42,8 @@
 
 #include "digg.h"
 #include "digg-item-view.h"
+#include "http-session.h"
+#include "circuit-breaker.h"
 
 static void initable_iface_init (gpointer g_iface, gpointer iface_data);
 static void query_iface_init (gpointer g_iface, gpointer iface_data);
@@ -56,6 +58,7 @@ G_DEFINE_TYPE_WITH_CODE (SwServiceDigg, sw_service_digg, SW_TYPE_SERVICE,
 struct _SwServiceDiggPrivate {
   RestProxy *proxy;
   gboolean inited; /* For GInitable */
+  guint init_id; /* Pending deferred_init_cb */
   gboolean configured; /* Set if we have user tokens */
   gboolean authorised; /* Set if the tokens are valid */
 };
@@ -97,7 +100,7 @@ get_dynamic_caps (SwService *service)
 
   if (priv->configured) {
     if (priv->authorised) {
-      return authorised_caps;
+      return circuit_breaker_get_caps (priv->proxy, authorised_caps);
     } else {
       return unauthorised_caps;
     }
@@ -167,6 +170,13 @@ sw_service_digg_dispose (GObject *object)
 {
   SwServiceDiggPrivate *priv = ((SwServiceDigg*)object)->priv;
 
+  sw_online_remove_notify (online_notify, object);
+
+  if (priv->init_id) {
+    g_source_remove (priv->init_id);
+    priv->init_id = 0;
+  }
+
   if (priv->proxy) {
     g_object_unref (priv->proxy);
     priv->proxy = NULL;
@@ -175,6 +185,21 @@ sw_service_digg_dispose (GObject *object)
   G_OBJECT_CLASS (sw_service_digg_parent_class)->dispose (object);
 }
 
+/*
+ * The keyring lookup is deferred to an idle so that the daemon can load every
+ * module first and the lookups of all services run concurrently.
+ */
+static gboolean
+deferred_init_cb (gpointer user_data)
+{
+  SwServiceDigg *digg = SW_SERVICE_DIGG (user_data);
+
+  digg->priv->init_id = 0;
+  credentials_updated (SW_SERVICE (digg));
+
+  return FALSE;
+}
+
 static gboolean
 sw_service_digg_initable (GInitable    *initable,
                           GCancellable *cancellable,
@@ -197,12 +222,14 @@ sw_service_digg_initable (GInitable    *initable,
   }
 
   priv->proxy = oauth_proxy_new (key, secret, "http://services.digg.com/", FALSE);
+  http_session_setup (priv->proxy, "digg");
+  circuit_breaker_attach (priv->proxy, SW_SERVICE (digg));
 
   sw_online_add_notify (online_notify, digg);
 
   priv->inited = TRUE;
 
-  credentials_updated (SW_SERVICE (digg));
+  priv->init_id = g_idle_add (deferred_init_cb, digg);
 
   return TRUE;
 }
@@ -22,7 +22,6 @@
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pango/pango.h>
 
 #include <rest/rest-proxy.h>
 #include <json-glib/json-glib.h>
@@ -31,139 +30,32 @@
 #include <libsocialweb/sw-utils.h>
 #include <libsocialweb/sw-debug.h>
 #include <libsocialweb/sw-item.h>
-#include <libsocialweb/sw-cache.h>
 
 #include "utils.h"
+#include "markup.h"
 
 #include "myspace-item-view.h"
 #include "myspace.h"
 
 G_DEFINE_TYPE (SwMySpaceItemView,
                sw_myspace_item_view,
-               SW_TYPE_ITEM_VIEW)
-
-#define GET_PRIVATE(o) \
-  (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_MYSPACE_ITEM_VIEW, SwMySpaceItemViewPrivate))
-
-typedef struct _SwMySpaceItemViewPrivate SwMySpaceItemViewPrivate;
-
-struct _SwMySpaceItemViewPrivate {
-  RestProxy *proxy;
-  guint timeout_id;
-  GHashTable *params;
-  gchar *query;
+               SW_TYPE_POLL_ITEM_VIEW)
+
+#define USER_HISTORY "1.0/statusmood/@me/@self/history"
+#define FRIENDS_HISTORY "1.0/statusmood/@me/@friends/history"
+
+static const PollItemViewInfo myspace_info = {
+  .name = "myspace",
+  .endpoint = NULL,
+  .default_page_size = 20,
+  .max_page_size = 100,
+  .max_pages = 10,
+  .count_param = "count",
+  .page_param = "startIndex",
+  .paging = POLL_PAGING_INDEX,
+  .first_page = 0
 };
 
-enum
-{
-  PROP_0,
-  PROP_PROXY,
-  PROP_PARAMS,
-  PROP_QUERY
-};
-
-#define UPDATE_TIMEOUT 5 * 60
-
-static void _service_item_hidden_cb (SwService   *service,
-                                     const gchar *uid,
-                                     SwItemView  *item_view);
-static void _service_user_changed_cb (SwService  *service,
-                                      SwItemView *item_view);
-static void _service_capabilities_changed_cb (SwService    *service,
-                                              const gchar **caps,
-                                              SwItemView   *item_view);
-
-static void
-sw_myspace_item_view_get_property (GObject    *object,
-                                guint       property_id,
-                                GValue     *value,
-                                GParamSpec *pspec)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (object);
-
-  switch (property_id) {
-    case PROP_PROXY:
-      g_value_set_object (value, priv->proxy);
-      break;
-    case PROP_PARAMS:
-      g_value_set_boxed (value, priv->params);
-      break;
-    case PROP_QUERY:
-      g_value_set_string (value, priv->query);
-      break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
-  }
-}
-
-static void
-sw_myspace_item_view_set_property (GObject      *object,
-                                   guint         property_id,
-                                   const GValue *value,
-                                   GParamSpec   *pspec)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (object);
-
-  switch (property_id) {
-    case PROP_PROXY:
-      if (priv->proxy)
-      {
-        g_object_unref (priv->proxy);
-      }
-      priv->proxy = g_value_dup_object (value);
-      break;
-    case PROP_PARAMS:
-      priv->params = g_value_dup_boxed (value);
-      break;
-    case PROP_QUERY:
-      priv->query = g_value_dup_string (value);
-      break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
-  }
-}
-
-static void
-sw_myspace_item_view_dispose (GObject *object)
-{
-  SwItemView *item_view = SW_ITEM_VIEW (object);
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (object);
-
-  if (priv->proxy) {
-    g_object_unref (priv->proxy);
-    priv->proxy = NULL;
-  }
-
-  if (priv->timeout_id) {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
-  }
-
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_item_hidden_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_user_changed_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_capabilities_changed_cb,
-                                        item_view);
-
-  G_OBJECT_CLASS (sw_myspace_item_view_parent_class)->dispose (object);
-}
-
-static void
-sw_myspace_item_view_finalize (GObject *object)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (object);
-
-  /* free private variables */
-  g_free (priv->query);
-  g_hash_table_unref (priv->params);
-
-  G_OBJECT_CLASS (sw_myspace_item_view_parent_class)->finalize (object);
-}
-
 static char *
 make_date (const char *s)
 {
@@ -181,7 +73,6 @@ make_item (SwService *service, JsonNode *entry)
   JsonNode *author;
   JsonObject *entry_obj, *author_obj;
   const char *tmp;
-  char *status;
 
   item = sw_item_new ();
   sw_item_set_service (item, service);
@@ -217,9 +108,8 @@ make_item (SwService *service, JsonNode *entry)
   sw_item_request_image_fetch (item, FALSE, "authoricon", g_strdup (tmp));;
 
   /* Get the content */
-  pango_parse_markup (json_object_get_string_member (entry_obj, "status"),
-                      -1, 0, NULL, &status, NULL, NULL);
-  sw_item_put (item, "content", status);
+  tmp = json_object_get_string_member (entry_obj, "status");
+  sw_item_take (item, "content", strip_markup (tmp));
   /* TODO: if mood is not "(none)" then append that to the status message */
 
   /* Get the date */
@@ -234,16 +124,54 @@ make_item (SwService *service, JsonNode *entry)
   return item;
 }
 
-static void
-_populate_set_from_node (SwService *service,
-                         SwSet     *set,
-                         JsonNode  *root)
+static const char *
+myspace_item_view_get_endpoint (SwPollItemView *view,
+                                guint           page,
+                                guint           step)
+{
+  const char *query = sw_poll_item_view_get_query (view);
+
+  if (step > 0)
+    return NULL;
+
+  if (g_str_equal (query, "own"))
+    return USER_HISTORY;
+  else if (g_str_equal (query, "feed"))
+    return FRIENDS_HISTORY;
+
+  g_error (G_STRLOC ": Unexpected query '%s'", query);
+  return NULL;
+}
+
+static gboolean
+myspace_item_view_prepare_call (SwPollItemView *view,
+                                RestProxyCall  *call,
+                                const char     *endpoint)
+{
+  rest_proxy_call_add_param (call, "fields", "author");
+
+  if (g_str_equal (endpoint, FRIENDS_HISTORY))
+    rest_proxy_call_add_param (call, "includeself", "true");
+
+  return TRUE;
+}
+
+static gint
+myspace_item_view_parse_page (SwPollItemView *view,
+                              RestProxyCall  *call,
+                              const char     *endpoint)
 {
-  JsonNode *entries;
+  SwService *service;
+  JsonNode *root, *entries;
   JsonArray *status_array;
   JsonObject *object;
   guint i, length;
 
+  root = json_node_from_call (call, "MySpace");
+  if (root == NULL)
+    return -1;
+  sw_poll_item_view_mark_parsed (view);
+
   /*
   The data format:
   "entry":[
@@ -271,299 +199,42 @@ _populate_set_from_node (SwService *service,
   */
   object = json_node_get_object (root);
   entries = json_object_get_member (object, "entry");
+  if (entries == NULL) {
+    json_node_free (root);
+    return -1;
+  }
 
   status_array = json_node_get_array (entries);
   length = json_array_get_length (status_array);
 
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+
   for (i=0; i<length; i++) {
     JsonNode *entry = json_array_get_element (status_array, i);
-    SwItem *item;
-
-    item = make_item (service, entry);
-
-    if (!sw_service_is_uid_banned (service, sw_item_get (item, "id"))) {
-      sw_set_add (set, (GObject *)item);
-    }
-
-    g_object_unref (item);
-  }
-}
-
-static void
-_got_status_cb (RestProxyCall *call,
-                const GError  *error,
-                GObject       *weak_object,
-                gpointer       userdata)
-{
-  SwMySpaceItemView *item_view = SW_MYSPACE_ITEM_VIEW (weak_object);
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set = (SwSet *)userdata;
-  JsonNode *root;
-  SwService *service;
-
-  if (error) {
-    g_message ("Error: %s", error->message);
-    return;
-  }
-
-  service = sw_item_view_get_service (SW_ITEM_VIEW (item_view));
-
-  root = json_node_from_call (call, "MySpace");
-  if (root == NULL)
-    return;
-
-  _populate_set_from_node (service, set, root);
-
-  g_object_unref (call);
-
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view), set);
-
-  /* Save the results of this set to the cache */
-  sw_cache_save (service,
-                 priv->query,
-                 priv->params,
-                 set);
+    const char *id;
 
-  sw_set_unref (set);
+    id = json_object_get_string_member (json_node_get_object (entry),
+                                        "statusId");
+    if (sw_poll_item_view_is_banned (view, "myspace-", id))
+      continue;
 
-  g_object_unref (root);
-}
-
-static void
-_get_user_status_updates (SwMySpaceItemView *item_view,
-                          SwSet             *set)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (item_view);
-  RestProxyCall *call;
-
-  call = rest_proxy_new_call (priv->proxy);
-
-  rest_proxy_call_set_function (call, "1.0/statusmood/@me/@self/history");
-  rest_proxy_call_add_params(call,
-                             "count", "20",
-                             "fields", "author",
-                             NULL);
-
-  rest_proxy_call_async (call, _got_status_cb, (GObject*)item_view, set, NULL);
-}
-
-static void
-_get_friends_status_updates (SwMySpaceItemView *item_view,
-                             SwSet             *set)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (item_view);
-  RestProxyCall *call;
-
-  call = rest_proxy_new_call (priv->proxy);
-
-  rest_proxy_call_set_function (call, "1.0/statusmood/@me/@friends/history");
-  rest_proxy_call_add_params(call,
-                             "includeself", "true",
-                             "count", "20",
-                             "fields", "author",
-                             NULL);
-
-  rest_proxy_call_async (call, _got_status_cb, (GObject*)item_view, set, NULL);
-}
-
-static void
-_get_status_updates (SwMySpaceItemView *item_view)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (item_view);
-  GHashTable *params = NULL;
-  SwSet *set;
-
-  set = sw_item_set_new ();
-
-  if (g_str_equal (priv->query, "own"))
-    _get_user_status_updates (item_view, set);
-  else if (g_str_equal (priv->query, "feed")) 
-    _get_friends_status_updates (item_view, set);
-  else
-    g_error (G_STRLOC ": Unexpected query '%s'", priv->query);
-
-  if (params)
-    g_hash_table_unref (params);
-}
-
-static gboolean
-_update_timeout_cb (gpointer data)
-{
-  SwMySpaceItemView *item_view = SW_MYSPACE_ITEM_VIEW (data);
-
-  _get_status_updates (item_view);
-
-  return TRUE;
-}
-
-static void
-_load_from_cache (SwMySpaceItemView *item_view)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set;
-
-  set = sw_cache_load (sw_item_view_get_service (SW_ITEM_VIEW (item_view)),
-                       priv->query,
-                       priv->params);
-
-  if (set)
-  {
-    sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                               set);
-    sw_set_unref (set);
-  }
-}
-
-static void
-myspace_item_view_start (SwItemView *item_view)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View already started.");
-  } else {
-    priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                              (GSourceFunc)_update_timeout_cb,
-                                              item_view);
-    _load_from_cache ((SwMySpaceItemView *)item_view);
-    _get_status_updates ((SwMySpaceItemView *)item_view);
-  }
-}
-
-static void
-myspace_item_view_stop (SwItemView *item_view)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (!priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View not running");
-  } else {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
-  }
-}
-
-static void
-myspace_item_view_refresh (SwItemView *item_view)
-{
-  _get_status_updates ((SwMySpaceItemView *)item_view);
-}
-
-static void
-_service_item_hidden_cb (SwService   *service,
-                         const gchar *uid,
-                         SwItemView  *item_view)
-{
-  sw_item_view_remove_by_uid (item_view, uid);
-}
-
-static void
-_service_user_changed_cb (SwService  *service,
-                          SwItemView *item_view)
-{
-  SwSet *set;
-
-  /* We need to empty the set */
-  set = sw_item_set_new ();
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                             set);
-  sw_set_unref (set);
-
-  /* And drop the cache */
-  sw_cache_drop_all (service);
-}
-
-static void
-_service_capabilities_changed_cb (SwService    *service,
-                                  const gchar **caps,
-                                  SwItemView   *item_view)
-{
-  SwMySpaceItemViewPrivate *priv = GET_PRIVATE ((SwMySpaceItemView*) item_view);
-
-  if (sw_service_has_cap (caps, CREDENTIALS_VALID))
-  {
-    myspace_item_view_refresh (item_view);
-
-    if (!priv->timeout_id)
-    {
-      priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                                (GSourceFunc)_update_timeout_cb,
-                                                item_view);
-    }
-  } else {
-    if (priv->timeout_id)
-    {
-      g_source_remove (priv->timeout_id);
-      priv->timeout_id = 0;
-    }
+    sw_poll_item_view_add_item (view, make_item (service, entry));
   }
-}
 
-static void
-sw_myspace_item_view_constructed (GObject *object)
-{
-  SwItemView *item_view = SW_ITEM_VIEW (object);
+  json_node_free (root);
 
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "item-hidden",
-                    (GCallback)_service_item_hidden_cb,
-                    item_view);
-
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "user-changed",
-                    (GCallback)_service_user_changed_cb,
-                    item_view);
-
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "capabilities-changed",
-                    (GCallback)_service_capabilities_changed_cb,
-                    item_view);
-
-  if (G_OBJECT_CLASS (sw_myspace_item_view_parent_class)->constructed)
-    G_OBJECT_CLASS (sw_myspace_item_view_parent_class)->constructed (object);
+  return length;
 }
 
 static void
 sw_myspace_item_view_class_init (SwMySpaceItemViewClass *klass)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  SwItemViewClass *item_view_class = SW_ITEM_VIEW_CLASS (klass);
-  GParamSpec *pspec;
-
-  g_type_class_add_private (klass, sizeof (SwMySpaceItemViewPrivate));
-
-  object_class->get_property = sw_myspace_item_view_get_property;
-  object_class->set_property = sw_myspace_item_view_set_property;
-  object_class->dispose = sw_myspace_item_view_dispose;
-  object_class->finalize = sw_myspace_item_view_finalize;
-  object_class->constructed = sw_myspace_item_view_constructed;
-
-  item_view_class->start = myspace_item_view_start;
-  item_view_class->stop = myspace_item_view_stop;
-  item_view_class->refresh = myspace_item_view_refresh;
-
-  pspec = g_param_spec_object ("proxy",
-                               "proxy",
-                               "proxy",
-                               REST_TYPE_PROXY,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PROXY, pspec);
-
-  pspec = g_param_spec_string ("query",
-                               "query",
-                               "query",
-                               NULL,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_QUERY, pspec);
-
-  pspec = g_param_spec_boxed ("params",
-                              "params",
-                              "params",
-                              G_TYPE_HASH_TABLE,
-                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PARAMS, pspec);
+  SwPollItemViewClass *poll_class = SW_POLL_ITEM_VIEW_CLASS (klass);
+
+  poll_class->info = &myspace_info;
+  poll_class->get_endpoint = myspace_item_view_get_endpoint;
+  poll_class->prepare_call = myspace_item_view_prepare_call;
+  poll_class->parse_page = myspace_item_view_parse_page;
 }
 
 static void
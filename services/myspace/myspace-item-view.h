@@ -21,7 +21,7 @@
 #define _SW_MYSPACE_ITEM_VIEW
 
 #include <glib-object.h>
-#include <libsocialweb/sw-item-view.h>
+#include "poll-item-view.h"
 
 G_BEGIN_DECLS
 
@@ -43,11 +43,11 @@ G_BEGIN_DECLS
   (G_TYPE_INSTANCE_GET_CLASS ((obj), SW_TYPE_MYSPACE_ITEM_VIEW, SwMySpaceItemViewClass))
 
 typedef struct {
-  SwItemView parent;
+  SwPollItemView parent;
 } SwMySpaceItemView;
 
 typedef struct {
-  SwItemViewClass parent_class;
+  SwPollItemViewClass parent_class;
 } SwMySpaceItemViewClass;
 
 GType sw_myspace_item_view_get_type (void);
@@ -45,6 +45,9 @@
 
 #include "myspace.h"
 #include "myspace-item-view.h"
+#include "outbox.h"
+#include "http-session.h"
+#include "circuit-breaker.h"
 
 static void initable_iface_init (gpointer g_iface, gpointer iface_data);
 static void query_iface_init (gpointer g_iface, gpointer iface_data);
@@ -68,11 +71,22 @@ G_DEFINE_TYPE_WITH_CODE (SwServiceMySpace,
 
 struct _SwServiceMySpacePrivate {
   gboolean inited;
+  guint init_id;
+  gboolean activated;
   RestProxy *proxy;
   char *user_id;
   char *image_url;
+  gboolean configured;
+  RestProxy *configured_proxy;
+  Outbox *outbox;
 };
 
+static RestProxyCall *make_status_call (const char *msg, gpointer user_data);
+static OutboxResult status_sent_cb (const char    *msg,
+                                    RestProxyCall *call,
+                                    const GError  *error,
+                                    gpointer       user_data);
+
 static JsonNode *
 node_from_call (RestProxyCall *call, JsonParser *parser)
 {
@@ -105,23 +119,6 @@ node_from_call (RestProxyCall *call, JsonParser *parser)
   return root;
 }
 
-static gboolean
-account_is_configured ()
-{
-  RestProxy *proxy;
-  gboolean configured = FALSE;
-  const char *key = NULL, *secret = NULL;
-
-  sw_keystore_get_key_secret ("myspace", &key, &secret);
-  proxy = oauth_proxy_new (key, secret, "http://api.myspace.com/", FALSE);
-
-  configured = sw_keyfob_oauth_sync ((OAuthProxy *)proxy);
-
-  g_object_unref (proxy);
-
-  return configured;
-}
-
 static const char **
 get_static_caps (SwService *service)
 {
@@ -145,7 +142,6 @@ static const char **
 get_dynamic_caps (SwService *service)
 {
   SwServiceMySpace *myspace = SW_SERVICE_MYSPACE (service);
-  gboolean configured = FALSE;
   static const char * caps[] = {
     IS_CONFIGURED,
     CREDENTIALS_VALID,
@@ -160,16 +156,50 @@ get_dynamic_caps (SwService *service)
   };
 
   if (myspace->priv->user_id)
-    return caps;
+    return circuit_breaker_get_caps (myspace->priv->proxy, caps);
 
-  configured = account_is_configured ();
-
-  if (configured) 
+  if (myspace->priv->configured)
     return configured_caps;
   else
     return no_caps;
 }
 
+/*
+ * Looking the tokens up in the keyring is slow, so whether the account is
+ * configured is checked once in the background and cached until the
+ * credentials are updated.
+ */
+static void
+check_configured_cb (RestProxy *proxy, gboolean authorised, gpointer user_data)
+{
+  SwService *service = SW_SERVICE (user_data);
+  SwServiceMySpacePrivate *priv = GET_PRIVATE (service);
+
+  /* Ignore the answer if the credentials changed in the meantime */
+  if (proxy == priv->configured_proxy) {
+    priv->configured_proxy = NULL;
+    priv->configured = authorised;
+    sw_service_emit_capabilities_changed (service, get_dynamic_caps (service));
+  }
+
+  g_object_unref (proxy);
+  g_object_unref (service);
+}
+
+static void
+check_configured (SwServiceMySpace *myspace)
+{
+  SwServiceMySpacePrivate *priv = GET_PRIVATE (myspace);
+  const char *key = NULL, *secret = NULL;
+
+  sw_keystore_get_key_secret ("myspace", &key, &secret);
+  priv->configured_proxy = oauth_proxy_new (key, secret, "http://api.myspace.com/", FALSE);
+
+  sw_keyfob_oauth ((OAuthProxy *)priv->configured_proxy,
+                   check_configured_cb,
+                   g_object_ref (myspace));
+}
+
 static void
 construct_user_data (SwServiceMySpace *myspace, JsonNode *root)
 {
@@ -230,7 +260,7 @@ got_tokens_cb (RestProxy *proxy, gboolean authorised, gpointer user_data)
   SwServiceMySpacePrivate *priv = GET_PRIVATE (myspace);
   RestProxyCall *call;
 
-  if (authorised) {
+  if (authorised && priv->activated) {
     call = rest_proxy_new_call (priv->proxy);
     rest_proxy_call_set_function (call, "1.0/people/@me/@self");
     rest_proxy_call_async (call, got_user_cb, (GObject*)myspace, NULL, NULL);
@@ -266,6 +296,8 @@ online_notify (gboolean online, gpointer user_data)
 static void
 refresh_credentials (SwServiceMySpace *myspace)
 {
+  check_configured (myspace);
+
   online_notify (FALSE, (SwService *)myspace);
   online_notify (TRUE, (SwService *)myspace);
 }
@@ -273,6 +305,9 @@ refresh_credentials (SwServiceMySpace *myspace)
 static void
 credentials_updated (SwService *service)
 {
+  /* The user just changed the account, so verify it straight away */
+  GET_PRIVATE (service)->activated = TRUE;
+
   refresh_credentials (SW_SERVICE_MYSPACE (service));
 
   sw_service_emit_user_changed (service);
@@ -286,6 +321,16 @@ sw_service_myspace_dispose (GObject *object)
 
   sw_online_remove_notify (online_notify, object);
 
+  if (priv->init_id) {
+    g_source_remove (priv->init_id);
+    priv->init_id = 0;
+  }
+
+  if (priv->outbox) {
+    outbox_free (priv->outbox);
+    priv->outbox = NULL;
+  }
+
   if (priv->proxy) {
     g_object_unref (priv->proxy);
     priv->proxy = NULL;
@@ -331,6 +376,50 @@ sw_service_myspace_init (SwServiceMySpace *self)
   self->priv->inited = FALSE;
 }
 
+/*
+ * The keyring lookups are deferred to an idle so that the daemon can load
+ * every module first and the lookups of all services run concurrently.
+ */
+static gboolean
+deferred_init_cb (gpointer user_data)
+{
+  SwServiceMySpace *myspace = SW_SERVICE_MYSPACE (user_data);
+
+  myspace->priv->init_id = 0;
+  refresh_credentials (myspace);
+
+  return FALSE;
+}
+
+/*
+ * Logging in waits until a client actually needs the service, so a cold
+ * start doesn't pay for logins nobody asked for.
+ */
+static void
+activate (SwServiceMySpace *myspace)
+{
+  SwServiceMySpacePrivate *priv = GET_PRIVATE (myspace);
+
+  if (priv->activated)
+    return;
+
+  priv->activated = TRUE;
+
+  if (sw_is_online () && priv->user_id == NULL)
+    online_notify (TRUE, myspace);
+}
+
+static void
+_capabilities_changed_cb (SwService    *service,
+                          const gchar **caps,
+                          gpointer      user_data)
+{
+  SwServiceMySpacePrivate *priv = GET_PRIVATE (service);
+
+  outbox_set_ready (priv->outbox,
+                    sw_service_has_cap (caps, CREDENTIALS_VALID));
+}
+
 /* Initable interface */
 
 static gboolean
@@ -354,10 +443,21 @@ sw_service_myspace_initable (GInitable     *initable,
     return FALSE;
   }
   priv->proxy = oauth_proxy_new (key, secret, "http://api.myspace.com/", FALSE);
+  http_session_setup (priv->proxy, "myspace");
+  circuit_breaker_attach (priv->proxy, SW_SERVICE (myspace));
+
+  priv->outbox = outbox_new ("myspace", G_OBJECT (myspace),
+                             make_status_call, status_sent_cb, myspace);
+  g_signal_connect (myspace, "capabilities-changed",
+                    G_CALLBACK (_capabilities_changed_cb), NULL);
+
+  /* Updates left over from the last run need a login to go out */
+  if (!outbox_is_empty (priv->outbox))
+    priv->activated = TRUE;
 
   sw_online_add_notify (online_notify, myspace);
 
-  refresh_credentials (myspace);
+  priv->init_id = g_idle_add (deferred_init_cb, myspace);
 
   priv->inited = TRUE;
 
@@ -410,6 +510,8 @@ _myspace_query_open_view (SwQueryIface          *self,
     return;
   }
 
+  activate (SW_SERVICE_MYSPACE (self));
+
   item_view = g_object_new (SW_TYPE_MYSPACE_ITEM_VIEW,
                             "proxy", priv->proxy,
                             "service", self,
@@ -454,6 +556,8 @@ _myspace_avatar_request_avatar (SwAvatarIface     *self,
 {
   SwServiceMySpacePrivate *priv = GET_PRIVATE (self);
 
+  activate (SW_SERVICE_MYSPACE (self));
+
   if (priv->image_url) {
     sw_web_download_image_async (priv->image_url,
                                  _requested_avatar_downloaded_cb,
@@ -474,20 +578,60 @@ avatar_iface_init (gpointer g_iface,
 
 /* Status Update interface */
 
-static void
-_update_status_cb (RestProxyCall *call,
-                   const GError  *error,
-                   GObject       *weak_object,
-                   gpointer       userdata)
+static RestProxyCall *
+make_status_call (const char *msg,
+                  gpointer    user_data)
 {
-  if (error)
-  {
+  SwServiceMySpacePrivate *priv = GET_PRIVATE (user_data);
+  RestProxyCall *call;
+  gchar *request_body;
+
+  if (!priv->user_id)
+    return NULL;
+
+  call = rest_proxy_new_call (priv->proxy);
+  rest_proxy_call_set_method (call, "PUT");
+  rest_proxy_call_set_function (call, "1.0/statusmood/@me/@self");
+
+  request_body = g_strdup_printf ("{ \"status\":\"%s\" }", msg);
+  rest_proxy_call_set_body (call, request_body);
+
+  return call;
+}
+
+static OutboxResult
+status_sent_cb (const char    *msg,
+                RestProxyCall *call,
+                const GError  *error,
+                gpointer       user_data)
+{
+  OutboxResult result;
+
+  result = outbox_classify (call, error);
+
+  switch (result) {
+  case OUTBOX_SENT:
+    sw_status_update_iface_emit_status_updated (user_data, TRUE);
+    break;
+  case OUTBOX_RETRY:
+    g_message ("Error updating status, will retry: %s", error->message);
+    break;
+  case OUTBOX_DROP:
     g_critical (G_STRLOC ": Error updating status: %s",
                 error->message);
-    sw_status_update_iface_emit_status_updated (weak_object, FALSE);
-  } else {
-    sw_status_update_iface_emit_status_updated (weak_object, TRUE);
+    sw_status_update_iface_emit_status_updated (user_data, FALSE);
+    break;
+  case OUTBOX_UNKNOWN:
+    g_message ("Status update may not have been posted: %s", error->message);
+    sw_status_update_iface_emit_status_updated (user_data, FALSE);
+    break;
+  case OUTBOX_HOLD:
+    g_message ("Status update held until the login is renewed: %s",
+               error->message);
+    break;
   }
+
+  return result;
 }
 
 static void
@@ -498,20 +642,11 @@ _myspace_status_update_update_status (SwStatusUpdateIface   *self,
 {
   SwServiceMySpace *myspace = (SwServiceMySpace *)self;
   SwServiceMySpacePrivate *priv = myspace->priv;
-  RestProxyCall *call;
-  gchar *request_body;
-
-  if (!priv->user_id)
-    return;
 
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_method (call, "PUT");
-  rest_proxy_call_set_function (call, "1.0/statusmood/@me/@self");
-
-  request_body = g_strdup_printf ("{ \"status\":\"%s\" }", msg);
-  rest_proxy_call_set_body (call, request_body);
+  activate (myspace);
 
-  rest_proxy_call_async (call, _update_status_cb, (GObject *)self, NULL, NULL);
+  /* Queued so that nothing is lost while offline or authorising */
+  outbox_push (priv->outbox, msg);
   sw_status_update_iface_return_from_update_status (context);
 }
 
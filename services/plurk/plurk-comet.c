@@ -0,0 +1,542 @@
+/*
+ * libsocialweb Plurk service support
+ *
+ * Copyright (C) 2010 Novell, Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include <rest/rest-proxy.h>
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+
+#include "utils.h"
+#include "rate-governor.h"
+
+#include "plurk-comet.h"
+
+/*
+ * Plurk pushes the events of a user's timeline down a realtime channel: the
+ * API hands out the channel's comet URL, which is then long-polled with the
+ * offset of the last event seen.  Every view of the service shares the one
+ * connection, held open for as long as anyone is subscribed and the
+ * credentials are valid.  It only counts as connected once the channel has
+ * answered a long poll.  When it drops, "dropped" tells the views to catch
+ * up by polling and the channel is asked for again after a backoff.  If the
+ * API turns the request for a channel down, "session-rejected" asks for a
+ * new login, which makes the channel ready again.
+ *
+ * Setting PLURK_COMET_SERVER to a URL skips asking the API for the channel
+ * and long-polls that URL instead, so the push path can be run against a
+ * local server.
+ */
+
+G_DEFINE_TYPE (SwPlurkComet, sw_plurk_comet, G_TYPE_OBJECT)
+
+#define GET_PRIVATE(o) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_PLURK_COMET, SwPlurkCometPrivate))
+
+typedef struct _SwPlurkCometPrivate SwPlurkCometPrivate;
+
+struct _SwPlurkCometPrivate {
+  RestProxy *proxy;
+  char *api_key;
+  /* The comet server holds requests open, so it gets a session of its own */
+  SoupSession *session;
+  guint subscribers;
+  gboolean ready;
+  /* Asking the API for the channel */
+  RestProxyCall *channel_call;
+  /* The channel URL and the offset of the next event wanted from it */
+  char *server;
+  gint64 offset;
+  /* The long poll in flight */
+  SoupMessage *msg;
+  gboolean connected;
+  guint retry_id;
+  guint backoff;
+};
+
+enum {
+  NEW_PLURKS,
+  DROPPED,
+  SESSION_REJECTED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+#define GET_CHANNEL "Realtime/getUserChannel"
+
+#define COMET_ENV "PLURK_COMET_SERVER"
+
+/* The server answers within a minute even if nothing happened */
+#define COMET_TIMEOUT 90
+
+/* Seconds to wait before reconnecting, doubling on every failure */
+#define COMET_MIN_BACKOFF 30
+#define COMET_MAX_BACKOFF 10 * 60
+
+/* Plurk's answer to an offset it no longer has */
+#define COMET_OFFSET_RESET -3
+
+static void _connect (SwPlurkComet *comet);
+static void _poll (SwPlurkComet *comet);
+
+static gboolean
+_is_wanted (SwPlurkCometPrivate *priv)
+{
+  return priv->ready && priv->subscribers > 0;
+}
+
+static gboolean
+_retry_cb (gpointer data)
+{
+  SwPlurkComet *comet = SW_PLURK_COMET (data);
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+
+  priv->retry_id = 0;
+
+  if (_is_wanted (priv))
+    _connect (comet);
+
+  return FALSE;
+}
+
+/* Lost the channel: tell the views if they were relying on it, retry later */
+static void
+_drop (SwPlurkComet *comet)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+  gboolean was_connected = priv->connected;
+
+  priv->connected = FALSE;
+  g_free (priv->server);
+  priv->server = NULL;
+
+  if (priv->backoff)
+    priv->backoff = MIN (priv->backoff * 2, COMET_MAX_BACKOFF);
+  else
+    priv->backoff = COMET_MIN_BACKOFF;
+
+  if (!priv->retry_id)
+    priv->retry_id = g_timeout_add_seconds (priv->backoff, _retry_cb, comet);
+
+  if (was_connected)
+    g_signal_emit (comet, signals[DROPPED], 0);
+}
+
+static void
+_disconnect (SwPlurkComet *comet)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+  RestProxyCall *call;
+  SoupMessage *msg;
+
+  if (priv->retry_id) {
+    g_source_remove (priv->retry_id);
+    priv->retry_id = 0;
+  }
+
+  /* Cleared first, so the callbacks know they are being cancelled */
+  if (priv->channel_call) {
+    call = priv->channel_call;
+    priv->channel_call = NULL;
+    rest_proxy_call_cancel (call);
+  }
+
+  if (priv->msg) {
+    msg = priv->msg;
+    priv->msg = NULL;
+    soup_session_cancel_message (priv->session, msg, SOUP_STATUS_CANCELLED);
+  }
+
+  g_free (priv->server);
+  priv->server = NULL;
+  priv->connected = FALSE;
+  priv->backoff = 0;
+}
+
+static void
+_update (SwPlurkComet *comet)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+
+  if (!_is_wanted (priv))
+    _disconnect (comet);
+  else if (!priv->channel_call && !priv->msg && !priv->retry_id)
+    _connect (comet);
+}
+
+/*
+ * The channel answers with a JSONP callback, CometChannel.scriptCallback({...});
+ * so the object is whatever lies between the outer parentheses.  A bare
+ * object is taken as is.
+ */
+static JsonParser *
+_parse_events (SoupMessage *msg)
+{
+  JsonParser *parser;
+  GError *error = NULL;
+  const char *data, *start, *end;
+  gsize length;
+
+  data = msg->response_body->data;
+  length = msg->response_body->length;
+
+  start = memchr (data, '(', length);
+  for (end = data + length; end > data && end[-1] != ')'; end--)
+    ;
+
+  if (start && end > start + 1) {
+    start++;
+    end--;
+  } else {
+    start = data;
+    end = data + length;
+  }
+
+  parser = json_parser_new ();
+  if (!json_parser_load_from_data (parser, start, end - start, &error)) {
+    g_message ("Error: %s", error->message);
+    g_error_free (error);
+    g_object_unref (parser);
+    return NULL;
+  }
+
+  if (!JSON_NODE_HOLDS_OBJECT (json_parser_get_root (parser))) {
+    g_object_unref (parser);
+    return NULL;
+  }
+
+  return parser;
+}
+
+static void
+_got_events_cb (SoupSession *session,
+                SoupMessage *msg,
+                gpointer     user_data)
+{
+  SwPlurkComet *comet = SW_PLURK_COMET (user_data);
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+  JsonParser *parser;
+  JsonObject *object;
+  JsonArray *events;
+  gint64 offset = 0;
+
+  /* Cancelled by _disconnect() */
+  if (msg != priv->msg)
+    return;
+
+  priv->msg = NULL;
+
+  if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code)) {
+    g_message ("Error: comet channel returned %d", msg->status_code);
+    _drop (comet);
+    return;
+  }
+
+  parser = _parse_events (msg);
+  if (parser == NULL) {
+    _drop (comet);
+    return;
+  }
+
+  object = json_node_get_object (json_parser_get_root (parser));
+
+  /* Every answer from the channel says where to carry on from */
+  if (json_object_has_member (object, "new_offset"))
+    offset = json_object_get_int_member (object, "new_offset");
+
+  if (offset < 0 && offset != COMET_OFFSET_RESET) {
+    g_message ("Error: comet channel returned no offset");
+    g_object_unref (parser);
+    _drop (comet);
+    return;
+  }
+
+  priv->connected = TRUE;
+  priv->backoff = 0;
+
+  /* The events since the old offset are gone, so the views catch up */
+  if (offset == COMET_OFFSET_RESET) {
+    priv->offset = 0;
+    g_signal_emit (comet, signals[DROPPED], 0);
+  } else {
+    priv->offset = offset;
+  }
+
+  if (json_object_has_member (object, "data")) {
+    events = json_object_get_array_member (object, "data");
+    if (events && json_array_get_length (events) > 0)
+      g_signal_emit (comet, signals[NEW_PLURKS], 0, events);
+  }
+
+  g_object_unref (parser);
+
+  /* The handlers may have unsubscribed the last view */
+  if (_is_wanted (priv) && priv->server && !priv->msg)
+    _poll (comet);
+}
+
+static void
+_poll (SwPlurkComet *comet)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+  char *url;
+
+  url = g_strdup_printf ("%s%coffset=%" G_GINT64_FORMAT,
+                         priv->server,
+                         strchr (priv->server, '?') ? '&' : '?',
+                         priv->offset);
+  priv->msg = soup_message_new (SOUP_METHOD_GET, url);
+  g_free (url);
+
+  if (priv->msg == NULL) {
+    g_message ("Error: invalid comet server %s", priv->server);
+    _drop (comet);
+    return;
+  }
+
+  soup_session_queue_message (priv->session, priv->msg, _got_events_cb, comet);
+}
+
+static void
+_got_channel_cb (RestProxyCall *call,
+                 const GError  *error,
+                 GObject       *weak_object,
+                 gpointer       userdata)
+{
+  SwPlurkComet *comet = SW_PLURK_COMET (weak_object);
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+  JsonNode *root;
+  JsonObject *object;
+  guint status;
+
+  /* Cancelled by _disconnect() */
+  if (call != priv->channel_call) {
+    g_object_unref (call);
+    return;
+  }
+
+  priv->channel_call = NULL;
+  rate_governor_update (priv->proxy, call);
+
+  if (error) {
+    g_message ("Error: %s", error->message);
+    status = rest_proxy_call_get_status_code (call);
+    g_object_unref (call);
+    _drop (comet);
+
+    /* Turned down rather than throttled, so the login is no good */
+    if (status >= 400 && status < 500 && status != 429)
+      g_signal_emit (comet, signals[SESSION_REJECTED], 0);
+    return;
+  }
+
+  root = json_node_from_call (call, "Plurk");
+  g_object_unref (call);
+
+  if (root == NULL) {
+    _drop (comet);
+    return;
+  }
+
+  object = json_node_get_object (root);
+  if (json_object_has_member (object, "comet_server"))
+    priv->server = g_strdup (json_object_get_string_member (object,
+                                                            "comet_server"));
+  json_node_free (root);
+
+  if (priv->server == NULL) {
+    _drop (comet);
+    return;
+  }
+
+  priv->offset = 0;
+  _poll (comet);
+}
+
+/*
+ * A channel only delivers what happens after it was handed out, which the
+ * fetch a view makes when it starts or catches up covers.
+ */
+static void
+_connect (SwPlurkComet *comet)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+  RestProxyCall *call;
+  const char *server;
+
+  server = g_getenv (COMET_ENV);
+  if (server && server[0]) {
+    priv->server = g_strdup (server);
+    priv->offset = 0;
+    _poll (comet);
+    return;
+  }
+
+  if (!rate_governor_acquire (priv->proxy, RATE_PRIORITY_POLL, 1)) {
+    _drop (comet);
+    return;
+  }
+
+  call = rest_proxy_new_call (priv->proxy);
+  rest_proxy_call_set_function (call, GET_CHANNEL);
+  rest_proxy_call_add_param (call, "api_key", priv->api_key);
+  rest_proxy_call_async (call, _got_channel_cb, (GObject *)comet, NULL, NULL);
+  priv->channel_call = call;
+}
+
+static void
+sw_plurk_comet_dispose (GObject *object)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (object);
+
+  _disconnect (SW_PLURK_COMET (object));
+
+  if (priv->session) {
+    soup_session_abort (priv->session);
+    g_object_unref (priv->session);
+    priv->session = NULL;
+  }
+
+  if (priv->proxy) {
+    g_object_unref (priv->proxy);
+    priv->proxy = NULL;
+  }
+
+  G_OBJECT_CLASS (sw_plurk_comet_parent_class)->dispose (object);
+}
+
+static void
+sw_plurk_comet_finalize (GObject *object)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (object);
+
+  g_free (priv->api_key);
+
+  G_OBJECT_CLASS (sw_plurk_comet_parent_class)->finalize (object);
+}
+
+static void
+sw_plurk_comet_class_init (SwPlurkCometClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (SwPlurkCometPrivate));
+
+  object_class->dispose = sw_plurk_comet_dispose;
+  object_class->finalize = sw_plurk_comet_finalize;
+
+  signals[NEW_PLURKS] = g_signal_new ("new-plurks",
+                                      G_TYPE_FROM_CLASS (klass),
+                                      G_SIGNAL_RUN_LAST,
+                                      G_STRUCT_OFFSET (SwPlurkCometClass,
+                                                       new_plurks),
+                                      NULL, NULL,
+                                      g_cclosure_marshal_VOID__POINTER,
+                                      G_TYPE_NONE, 1,
+                                      G_TYPE_POINTER);
+
+  signals[DROPPED] = g_signal_new ("dropped",
+                                   G_TYPE_FROM_CLASS (klass),
+                                   G_SIGNAL_RUN_LAST,
+                                   G_STRUCT_OFFSET (SwPlurkCometClass,
+                                                    dropped),
+                                   NULL, NULL,
+                                   g_cclosure_marshal_VOID__VOID,
+                                   G_TYPE_NONE, 0);
+
+  signals[SESSION_REJECTED] = g_signal_new ("session-rejected",
+                                            G_TYPE_FROM_CLASS (klass),
+                                            G_SIGNAL_RUN_LAST,
+                                            G_STRUCT_OFFSET (SwPlurkCometClass,
+                                                             session_rejected),
+                                            NULL, NULL,
+                                            g_cclosure_marshal_VOID__VOID,
+                                            G_TYPE_NONE, 0);
+}
+
+static void
+sw_plurk_comet_init (SwPlurkComet *self)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (self);
+
+  priv->session = soup_session_async_new_with_options (SOUP_SESSION_TIMEOUT,
+                                                       COMET_TIMEOUT,
+                                                       NULL);
+}
+
+SwPlurkComet *
+sw_plurk_comet_new (RestProxy  *proxy,
+                    const char *api_key)
+{
+  SwPlurkComet *comet;
+  SwPlurkCometPrivate *priv;
+
+  comet = g_object_new (SW_TYPE_PLURK_COMET, NULL);
+  priv = GET_PRIVATE (comet);
+  priv->proxy = g_object_ref (proxy);
+  priv->api_key = g_strdup (api_key);
+
+  return comet;
+}
+
+/* Whether the session is logged in, which the channel needs */
+void
+sw_plurk_comet_set_ready (SwPlurkComet *comet,
+                          gboolean      ready)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+
+  if (priv->ready == ready)
+    return;
+
+  priv->ready = ready;
+  _update (comet);
+}
+
+/* The channel is held open while anyone is subscribed */
+void
+sw_plurk_comet_subscribe (SwPlurkComet *comet)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+
+  priv->subscribers++;
+  _update (comet);
+}
+
+void
+sw_plurk_comet_unsubscribe (SwPlurkComet *comet)
+{
+  SwPlurkCometPrivate *priv = GET_PRIVATE (comet);
+
+  g_return_if_fail (priv->subscribers > 0);
+
+  priv->subscribers--;
+  _update (comet);
+}
+
+/* Whether new plurks are being pushed, so polling for them can stop */
+gboolean
+sw_plurk_comet_is_connected (SwPlurkComet *comet)
+{
+  return GET_PRIVATE (comet)->connected;
+}
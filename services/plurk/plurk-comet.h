@@ -0,0 +1,75 @@
+/*
+ * libsocialweb Plurk service support
+ *
+ * Copyright (C) 2010 Novell, Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _SW_PLURK_COMET
+#define _SW_PLURK_COMET
+
+#include <glib-object.h>
+#include <rest/rest-proxy.h>
+
+G_BEGIN_DECLS
+
+#define SW_TYPE_PLURK_COMET sw_plurk_comet_get_type()
+
+#define SW_PLURK_COMET(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), SW_TYPE_PLURK_COMET, SwPlurkComet))
+
+#define SW_PLURK_COMET_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), SW_TYPE_PLURK_COMET, SwPlurkCometClass))
+
+#define SW_IS_PLURK_COMET(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SW_TYPE_PLURK_COMET))
+
+#define SW_IS_PLURK_COMET_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), SW_TYPE_PLURK_COMET))
+
+#define SW_PLURK_COMET_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), SW_TYPE_PLURK_COMET, SwPlurkCometClass))
+
+typedef struct {
+  GObject parent;
+} SwPlurkComet;
+
+typedef struct {
+  GObjectClass parent_class;
+
+  /* The JsonArray of events the channel delivered */
+  void (*new_plurks)       (SwPlurkComet *comet,
+                            gpointer      events);
+  /* The connection was lost, so anything since may have been missed */
+  void (*dropped)          (SwPlurkComet *comet);
+  /* The API refused the channel, so the session needs logging in again */
+  void (*session_rejected) (SwPlurkComet *comet);
+} SwPlurkCometClass;
+
+GType sw_plurk_comet_get_type (void);
+
+SwPlurkComet *sw_plurk_comet_new          (RestProxy    *proxy,
+                                           const char   *api_key);
+void          sw_plurk_comet_set_ready    (SwPlurkComet *comet,
+                                           gboolean      ready);
+void          sw_plurk_comet_subscribe    (SwPlurkComet *comet);
+void          sw_plurk_comet_unsubscribe  (SwPlurkComet *comet);
+gboolean      sw_plurk_comet_is_connected (SwPlurkComet *comet);
+
+G_END_DECLS
+
+#endif /* _SW_PLURK_COMET */
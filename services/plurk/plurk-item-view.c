@@ -26,21 +26,21 @@
 #include <libsocialweb/sw-utils.h>
 
 #include <rest/rest-proxy.h>
-#include <rest/rest-xml-parser.h>
 #include <libsoup/soup.h>
 #include <json-glib/json-glib.h>
 
 #include <libsocialweb/sw-debug.h>
 #include <libsocialweb/sw-item.h>
-#include <libsocialweb/sw-cache.h>
 
 #include "utils.h"
 
 #include "plurk-item-view.h"
+#include "plurk-comet.h"
+#include "plurk.h"
 
 G_DEFINE_TYPE (SwPlurkItemView,
                sw_plurk_item_view,
-               SW_TYPE_ITEM_VIEW)
+               SW_TYPE_POLL_ITEM_VIEW)
 
 #define GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_PLURK_ITEM_VIEW, SwPlurkItemViewPrivate))
@@ -48,33 +48,51 @@ G_DEFINE_TYPE (SwPlurkItemView,
 typedef struct _SwPlurkItemViewPrivate SwPlurkItemViewPrivate;
 
 struct _SwPlurkItemViewPrivate {
-  RestProxy *proxy;
   gchar *api_key;
-  guint timeout_id;
-  GHashTable *params;
-  gchar *query;
+  /* The plurk_users seen by recent fetches, by numeric user id */
+  GHashTable *users;
+  /*
+   * The plurk ids seen by the fetch of that generation.  The next page
+   * starts at the time of the last plurk, so those posted in the same second
+   * come round again.
+   */
+  GHashTable *seen;
+  guint seen_generation;
+  /* The service's realtime channel, while the view is subscribed to it */
+  SwPlurkComet *comet;
 };
 
+typedef struct {
+  gint64 id;
+  char *uid;
+  char *name;
+  gint64 avatar;
+  gint64 has_profile;
+  char *avatar_url;
+  /* The fetch that last mentioned this user */
+  guint generation;
+} PlurkUser;
+
 enum
 {
   PROP_0,
-  PROP_PROXY,
-  PROP_APIKEY,
-  PROP_PARAMS,
-  PROP_QUERY
+  PROP_APIKEY
 };
 
-#define UPDATE_TIMEOUT 5 * 60
-
-static void _service_item_hidden_cb (SwService   *service,
-                                     const gchar *uid,
-                                     SwItemView  *item_view);
-
-static void _service_user_changed_cb (SwService  *service,
-                                      SwItemView *item_view);
-static void _service_capabilities_changed_cb (SwService    *service,
-                                              const gchar **caps,
-                                              SwItemView   *item_view);
+#define GET_PLURKS "Timeline/getPlurks"
+
+/* TODO Request plurks for "own" or "feed" */
+static const PollItemViewInfo plurk_info = {
+  .name = "plurk",
+  .endpoint = GET_PLURKS,
+  .default_page_size = 20,
+  .max_page_size = 50,
+  .max_pages = 10,
+  .count_param = "limit",
+  .page_param = "offset",
+  .paging = POLL_PAGING_CURSOR,
+  .first_page = 0
+};
 
 static void
 sw_plurk_item_view_get_property (GObject    *object,
@@ -85,18 +103,9 @@ sw_plurk_item_view_get_property (GObject    *object,
   SwPlurkItemViewPrivate *priv = GET_PRIVATE (object);
 
   switch (property_id) {
-    case PROP_PROXY:
-      g_value_set_object (value, priv->proxy);
-      break;
     case PROP_APIKEY:
       g_value_set_string (value, priv->api_key);
       break;
-    case PROP_PARAMS:
-      g_value_set_boxed (value, priv->params);
-      break;
-    case PROP_QUERY:
-      g_value_set_string (value, priv->query);
-      break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -111,70 +120,23 @@ sw_plurk_item_view_set_property (GObject      *object,
   SwPlurkItemViewPrivate *priv = GET_PRIVATE (object);
 
   switch (property_id) {
-    case PROP_PROXY:
-      if (priv->proxy)
-      {
-        g_object_unref (priv->proxy);
-      }
-      priv->proxy = g_value_dup_object (value);
-      break;
     case PROP_APIKEY:
-      if (priv->api_key)
-      {
-        g_object_unref (priv->api_key);
-      }
+      g_free (priv->api_key);
       priv->api_key = g_value_dup_string (value);
       break;
-    case PROP_PARAMS:
-      priv->params = g_value_dup_boxed (value);
-      break;
-    case PROP_QUERY:
-      priv->query = g_value_dup_string (value);
-      break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
 }
 
-static void
-sw_plurk_item_view_dispose (GObject *object)
-{
-  SwItemView *item_view = SW_ITEM_VIEW (object);
-  SwPlurkItemViewPrivate *priv = GET_PRIVATE (object);
-
-  if (priv->proxy)
-  {
-    g_object_unref (priv->proxy);
-    priv->proxy = NULL;
-  }
-
-  if (priv->timeout_id)
-  {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
-  }
-
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_item_hidden_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_user_changed_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_capabilities_changed_cb,
-                                        item_view);
-
-  G_OBJECT_CLASS (sw_plurk_item_view_parent_class)->dispose (object);
-}
-
 static void
 sw_plurk_item_view_finalize (GObject *object)
 {
   SwPlurkItemViewPrivate *priv = GET_PRIVATE (object);
 
   g_free (priv->api_key);
-  g_free (priv->query);
-  g_hash_table_unref (priv->params);
+  g_hash_table_destroy (priv->users);
+  g_hash_table_destroy (priv->seen);
 
   G_OBJECT_CLASS (sw_plurk_item_view_parent_class)->finalize (object);
 }
@@ -189,7 +151,8 @@ construct_image_url (const char *uid,
   if (has_profile == 1 && avatar <= 0)
     url = g_strdup_printf ("http://avatars.plurk.com/%s-medium.gif", uid);
   else if (has_profile == 1 && avatar > 0)
-    url = g_strdup_printf ("http://avatars.plurk.com/%s-medium%lld.gif", uid, avatar);
+    url = g_strdup_printf ("http://avatars.plurk.com/%s-medium%" G_GINT64_FORMAT
+                           ".gif", uid, avatar);
   else
     url = g_strdup_printf ("http://www.plurk.com/static/default_medium.gif");
 
@@ -233,18 +196,104 @@ make_date (const char *s)
   return sw_time_t_to_string (timegm (&tm));
 }
 
-static SwItem *
-make_item (SwService *service, JsonNode *plurk_node, JsonNode *plurk_users)
+/* Plurk pages back by the time of the oldest plurk seen so far */
+static char *
+make_offset (const char *s)
+{
+  struct tm tm;
+  char offset[32];
+
+  memset (&tm, 0, sizeof (tm));
+  strptime (s, "%A, %d %h %Y %H:%M:%S GMT", &tm);
+  strftime (offset, sizeof (offset), "%Y-%m-%dT%H:%M:%S", &tm);
+
+  return g_strdup (offset);
+}
+
+static void
+plurk_user_free (PlurkUser *user)
+{
+  g_free (user->uid);
+  g_free (user->name);
+  g_free (user->avatar_url);
+  g_slice_free (PlurkUser, user);
+}
+
+/*
+ * Decode the plurk_users of a response into the user table once, so the
+ * plurks can be joined against it by id.  Users that recur keep their entry
+ * and only have the avatar url rebuilt if their avatar changed.
+ */
+static void
+update_users (SwPlurkItemViewPrivate *priv,
+              JsonNode               *plurk_users,
+              guint                   generation)
 {
-  JsonNode *node;
-  JsonObject *plurk, *user, *object;
-  char *uid, *pid, *url, *date, *base36, *content;
-  const char *name, *qualifier;
+  JsonObject *object, *user_obj;
+  PlurkUser *user;
+  GList *members, *l;
+  const char *name;
   gint64 id, avatar, has_profile;
-  SwItem *item;
 
-  item = sw_item_new ();
-  sw_item_set_service (item, service);
+  object = json_node_get_object (plurk_users);
+  members = json_object_get_members (object);
+
+  for (l = members; l; l = l->next) {
+    user_obj = json_object_get_object_member (object, l->data);
+    if (!user_obj)
+      continue;
+
+    id = g_ascii_strtoll (l->data, NULL, 10);
+    name = json_object_get_string_member (user_obj, "full_name");
+    avatar = json_object_get_int_member (user_obj, "avatar");
+    has_profile = json_object_get_int_member (user_obj, "has_profile_image");
+
+    user = g_hash_table_lookup (priv->users, &id);
+    if (!user) {
+      user = g_slice_new0 (PlurkUser);
+      user->id = id;
+      user->uid = g_strdup_printf ("%" G_GINT64_FORMAT, id);
+      g_hash_table_insert (priv->users, &user->id, user);
+    }
+
+    if (g_strcmp0 (user->name, name) != 0) {
+      g_free (user->name);
+      user->name = g_strdup (name);
+    }
+
+    if (!user->avatar_url ||
+        user->avatar != avatar || user->has_profile != has_profile) {
+      g_free (user->avatar_url);
+      user->avatar = avatar;
+      user->has_profile = has_profile;
+      user->avatar_url = construct_image_url (user->uid, avatar, has_profile);
+    }
+
+    user->generation = generation;
+  }
+
+  g_list_free (members);
+}
+
+static gboolean
+_user_is_stale (gpointer key,
+                gpointer value,
+                gpointer userdata)
+{
+  PlurkUser *user = value;
+
+  return user->generation != GPOINTER_TO_UINT (userdata);
+}
+
+static SwItem *
+make_item (SwService *service, JsonNode *plurk_node, GHashTable *users)
+{
+  JsonObject *plurk;
+  PlurkUser *user;
+  char *pid, *url, *date, *base36, *content;
+  const char *qualifier;
+  gint64 id;
+  SwItem *item;
 
   /* Get the plurk object */
   plurk = json_node_get_object (plurk_node);
@@ -252,34 +301,29 @@ make_item (SwService *service, JsonNode *plurk_node, JsonNode *plurk_users)
   if (!json_object_has_member (plurk, "owner_id"))
     return NULL;
 
-  /* Get the user object */
+  /* Get the user */
   id = json_object_get_int_member (plurk, "owner_id");
-  uid = g_strdup_printf ("%lld", id);
-  object = json_node_get_object (plurk_users);
-  node = json_object_get_member (object, uid);
-  user = json_node_get_object (node);
+  user = g_hash_table_lookup (users, &id);
 
   if (!user)
     return NULL;
 
+  item = sw_item_new ();
+  sw_item_set_service (item, service);
+
   /* authorid */
-  sw_item_take (item, "authorid", uid);
+  sw_item_put (item, "authorid", user->uid);
 
   /* Construct the id of sw_item */
   id = json_object_get_int_member (plurk, "plurk_id");
-  pid = g_strdup_printf ("%lld", id);
+  pid = g_strdup_printf ("%" G_GINT64_FORMAT, id);
   sw_item_take (item, "id", g_strconcat ("plurk-", pid, NULL));
 
   /* Get the display name of the user */
-  name = json_object_get_string_member (user, "full_name");
-  sw_item_put (item, "author", name);
+  sw_item_put (item, "author", user->name);
 
-  /* Construct the avatar url */
-  avatar = json_object_get_int_member (user, "avatar");
-  has_profile = json_object_get_int_member (user, "has_profile_image");
-  url = construct_image_url (uid, avatar, has_profile);
-  sw_item_request_image_fetch (item, FALSE, "authoricon", url);
-  g_free (url);
+  /* The avatar url */
+  sw_item_request_image_fetch (item, FALSE, "authoricon", user->avatar_url);
 
   /* Construct the content of the plurk*/
   if (json_object_has_member (plurk, "qualifier_translated"))
@@ -304,40 +348,54 @@ make_item (SwService *service, JsonNode *plurk_node, JsonNode *plurk_users)
   return item;
 }
 
-static void
-_got_status_updates_cb (RestProxyCall *call,
-                        const GError  *error,
-                        GObject       *weak_object,
-                        gpointer       userdata)
+static gboolean
+plurk_item_view_prepare_call (SwPollItemView *view,
+                              RestProxyCall  *call,
+                              const char     *endpoint)
+{
+  SwPlurkItemViewPrivate *priv = GET_PRIVATE (view);
+
+  rest_proxy_call_add_param (call, "api_key", priv->api_key);
+
+  return TRUE;
+}
+
+static gint
+plurk_item_view_parse_page (SwPollItemView *view,
+                            RestProxyCall  *call,
+                            const char     *endpoint)
 {
-  SwPlurkItemView *item_view = SW_PLURK_ITEM_VIEW (weak_object);
-  SwPlurkItemViewPrivate *priv = GET_PRIVATE (item_view);
+  SwPlurkItemViewPrivate *priv = GET_PRIVATE (view);
   SwService *service;
   JsonNode *root, *plurks, *plurk_users;
   JsonArray *plurks_array;
-  JsonObject *object;
-  SwSet *set;
-  guint i, length;
-
-  if (error) {
-    g_message ("Error: %s", error->message);
-    g_message ("Error: %s", rest_proxy_call_get_payload(call));
-    return;
-  }
+  JsonObject *object, *last;
+  char *offset = NULL;
+  guint i, length, generation;
+  gboolean fresh = FALSE;
 
   root = json_node_from_call (call, "Plurk");
   if (!root)
-    return;
+    return -1;
+  sw_poll_item_view_mark_parsed (view);
 
   object = json_node_get_object (root);
   if (!json_object_has_member (object, "plurks") ||
-      !json_object_has_member (object, "plurk_users"))
-    return;
+      !json_object_has_member (object, "plurk_users")) {
+    json_node_free (root);
+    return -1;
+  }
 
-  service = sw_item_view_get_service (SW_ITEM_VIEW (item_view));
-  set = sw_item_set_new ();
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
   plurks = json_object_get_member (object, "plurks");
   plurk_users = json_object_get_member (object, "plurk_users");
+  generation = sw_poll_item_view_get_generation (view);
+  update_users (priv, plurk_users, generation);
+
+  if (priv->seen_generation != generation) {
+    g_hash_table_remove_all (priv->seen);
+    priv->seen_generation = generation;
+  }
 
   /* Parser the data and file the set */
   plurks_array = json_node_get_array (plurks);
@@ -345,214 +403,201 @@ _got_status_updates_cb (RestProxyCall *call,
 
   for (i=0; i<length; i++) {
     JsonNode *plurk_node = json_array_get_element (plurks_array, i);
+    JsonObject *plurk = json_node_get_object (plurk_node);
     SwItem *item;
+    char id[32];
 
-    item = make_item (service, plurk_node, plurk_users);
-    if (!item)
+    g_snprintf (id, sizeof (id), "%" G_GINT64_FORMAT,
+                json_object_get_int_member (plurk, "plurk_id"));
+    if (g_hash_table_lookup (priv->seen, id))
       continue;
+    g_hash_table_insert (priv->seen, g_strdup (id), GINT_TO_POINTER (TRUE));
+    fresh = TRUE;
 
-    /* Add the item into the set */
-    if (!sw_service_is_uid_banned (service,
-                                   sw_item_get (item, "id"))) {
-      sw_set_add (set, G_OBJECT (item));
-    }
-    g_object_unref (item);
+    if (sw_poll_item_view_is_banned (view, "plurk-", id))
+      continue;
+
+    item = make_item (service, plurk_node, priv->users);
+    if (item)
+      sw_poll_item_view_add_item (view, item);
   }
 
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                             set);
+  /* A page of nothing but repeats would only be asked for again */
+  if (fresh) {
+    last = json_node_get_object (json_array_get_element (plurks_array,
+                                                         length - 1));
+    if (json_object_has_member (last, "posted"))
+      offset = make_offset (json_object_get_string_member (last, "posted"));
+  }
+  sw_poll_item_view_set_cursor (view, offset);
+  g_free (offset);
 
-  /* Save the results of this set to the cache */
-  sw_cache_save (service,
-                 priv->query,
-                 priv->params,
-                 set);
+  json_node_free (root);
 
-  g_object_unref (call);
+  return length;
 }
 
 static void
-_get_status_updates (SwPlurkItemView *item_view)
+plurk_item_view_call_failed (SwPollItemView *view,
+                             RestProxyCall  *call,
+                             const GError   *error)
 {
-  SwPlurkItemViewPrivate *priv = GET_PRIVATE (item_view);
-  RestProxyCall *call;
-
-  call = rest_proxy_new_call (priv->proxy);
+  SwService *service;
 
-  /* TODO Request plurks for "own" or "feed" */
-  rest_proxy_call_set_function (call, "Timeline/getPlurks");
+  g_message ("Error: %s", rest_proxy_call_get_payload (call));
 
-  rest_proxy_call_add_params (call,
-                              "api_key", priv->api_key,
-                              "limit", "20",
-                              NULL);
-  rest_proxy_call_async (call, _got_status_updates_cb, (GObject*)item_view, NULL, NULL);
+  if (sw_service_plurk_session_rejected (call)) {
+    service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+    sw_service_plurk_invalidate_session (SW_SERVICE_PLURK (service));
+  }
 }
 
-static gboolean
-_update_timeout_cb (gpointer data)
+static void
+plurk_item_view_fetch_finished (SwPollItemView *view)
 {
-  SwPlurkItemView *item_view = SW_PLURK_ITEM_VIEW (data);
-
-  _get_status_updates (item_view);
+  SwPlurkItemViewPrivate *priv = GET_PRIVATE (view);
+  guint generation = sw_poll_item_view_get_generation (view);
 
-  return TRUE;
+  /* Forget the users nobody in this fetch mentioned */
+  g_hash_table_foreach_remove (priv->users, _user_is_stale,
+                               GUINT_TO_POINTER (generation));
+  g_hash_table_remove_all (priv->seen);
 }
 
 static void
-_load_from_cache (SwPlurkItemView *item_view)
+plurk_item_view_user_changed (SwPollItemView *view)
 {
-  SwPlurkItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set;
-
-  set = sw_cache_load (sw_item_view_get_service (SW_ITEM_VIEW (item_view)),
-                       priv->query,
-                       priv->params);
-
-  if (set)
-  {
-    sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                               set);
-    sw_set_unref (set);
-  }
+  SwPlurkItemViewPrivate *priv = GET_PRIVATE (view);
+
+  g_hash_table_remove_all (priv->users);
 }
 
+/*
+ * New plurks pushed down the realtime channel are added as they come.  The
+ * channel only carries the plurks, so one by a user no fetch has mentioned
+ * yet is left to a fetch to pick up.
+ */
 static void
-plurk_item_view_start (SwItemView *item_view)
+_comet_new_plurks_cb (SwPlurkComet   *comet,
+                      JsonArray      *events,
+                      SwPollItemView *view)
 {
-  SwPlurkItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View already started.");
-  } else {
-    priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                              (GSourceFunc)_update_timeout_cb,
-                                              item_view);
-    _load_from_cache ((SwPlurkItemView *)item_view);
-    _get_status_updates ((SwPlurkItemView *)item_view);
+  SwPlurkItemViewPrivate *priv = GET_PRIVATE (view);
+  SwService *service;
+  GList *items = NULL;
+  gboolean missed = FALSE;
+  guint i, length;
+
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+  length = json_array_get_length (events);
+
+  for (i = 0; i < length; i++) {
+    JsonNode *node = json_array_get_element (events, i);
+    JsonObject *event;
+    SwItem *item;
+    char id[32];
+
+    if (!JSON_NODE_HOLDS_OBJECT (node))
+      continue;
+
+    event = json_node_get_object (node);
+    if (!json_object_has_member (event, "type") ||
+        !json_object_has_member (event, "plurk_id") ||
+        g_strcmp0 (json_object_get_string_member (event, "type"),
+                   "new_plurk") != 0)
+      continue;
+
+    g_snprintf (id, sizeof (id), "%" G_GINT64_FORMAT,
+                json_object_get_int_member (event, "plurk_id"));
+    if (sw_poll_item_view_is_banned (view, "plurk-", id))
+      continue;
+
+    item = make_item (service, node, priv->users);
+    if (item)
+      items = g_list_prepend (items, item);
+    else
+      missed = TRUE;
   }
-}
 
-static void
-plurk_item_view_stop (SwItemView *item_view)
-{
-  SwPlurkItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (!priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View not running");
-  } else {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
+  if (items) {
+    sw_poll_item_view_push_items (view, items);
+    g_list_foreach (items, (GFunc)g_object_unref, NULL);
+    g_list_free (items);
   }
-}
 
-static void
-plurk_item_view_refresh (SwItemView *item_view)
-{
-  _get_status_updates ((SwPlurkItemView *)item_view);
+  if (missed)
+    sw_poll_item_view_fetch_soon (view);
 }
 
+/* Whatever was pushed while the channel was down has to be fetched */
 static void
-_service_item_hidden_cb (SwService   *service,
-                         const gchar *uid,
-                         SwItemView  *item_view)
+_comet_dropped_cb (SwPlurkComet   *comet,
+                   SwPollItemView *view)
 {
-  sw_item_view_remove_by_uid (item_view, uid);
+  sw_poll_item_view_fetch_soon (view);
 }
 
-static void
-_service_user_changed_cb (SwService  *service,
-                          SwItemView *item_view)
+static gboolean
+plurk_item_view_is_pushed (SwPollItemView *view)
 {
-  SwSet *set;
-
-  /* We need to empty the set */
-  set = sw_item_set_new ();
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                             set);
-  sw_set_unref (set);
+  SwPlurkItemViewPrivate *priv = GET_PRIVATE (view);
 
-  /* And drop the cache */
-  sw_cache_drop_all (service);
+  return priv->comet && sw_plurk_comet_is_connected (priv->comet);
 }
 
+/* Only the feed is pushed; the channel is held while a feed view polls */
 static void
-_service_capabilities_changed_cb (SwService    *service,
-                                  const gchar **caps,
-                                  SwItemView   *item_view)
+plurk_item_view_polling_changed (SwPollItemView *view,
+                                 gboolean        polling)
 {
-  SwPlurkItemViewPrivate *priv = GET_PRIVATE ((SwPlurkItemView*) item_view);
+  SwPlurkItemViewPrivate *priv = GET_PRIVATE (view);
+  SwService *service;
 
-  if (sw_service_has_cap (caps, CREDENTIALS_VALID))
-  {
-    plurk_item_view_refresh (item_view);
+  if (!g_str_equal (sw_poll_item_view_get_query (view), "feed"))
+    return;
 
-    if (!priv->timeout_id)
-    {
-      priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                                (GSourceFunc)_update_timeout_cb,
-                                                item_view);
-    }
-  } else {
-    if (priv->timeout_id)
-    {
-      g_source_remove (priv->timeout_id);
-      priv->timeout_id = 0;
-    }
+  if (polling && !priv->comet) {
+    service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+    priv->comet = g_object_ref
+      (sw_service_plurk_get_comet (SW_SERVICE_PLURK (service)));
+
+    g_signal_connect (priv->comet, "new-plurks",
+                      G_CALLBACK (_comet_new_plurks_cb), view);
+    g_signal_connect (priv->comet, "dropped",
+                      G_CALLBACK (_comet_dropped_cb), view);
+    sw_plurk_comet_subscribe (priv->comet);
+  } else if (!polling && priv->comet) {
+    g_signal_handlers_disconnect_by_func (priv->comet,
+                                          _comet_new_plurks_cb, view);
+    g_signal_handlers_disconnect_by_func (priv->comet,
+                                          _comet_dropped_cb, view);
+    sw_plurk_comet_unsubscribe (priv->comet);
+    g_object_unref (priv->comet);
+    priv->comet = NULL;
   }
 }
 
-static void
-sw_plurk_item_view_constructed (GObject *object)
-{
-  SwItemView *item_view = SW_ITEM_VIEW (object);
-
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "item-hidden",
-                    (GCallback)_service_item_hidden_cb,
-                    item_view);
-
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "user-changed",
-                    (GCallback)_service_user_changed_cb,
-                    item_view);
-
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "capabilities-changed",
-                    (GCallback)_service_capabilities_changed_cb,
-                    item_view);
-
-  if (G_OBJECT_CLASS (sw_plurk_item_view_parent_class)->constructed)
-    G_OBJECT_CLASS (sw_plurk_item_view_parent_class)->constructed (object);
-}
-
 static void
 sw_plurk_item_view_class_init (SwPlurkItemViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  SwItemViewClass *item_view_class = SW_ITEM_VIEW_CLASS (klass);
+  SwPollItemViewClass *poll_class = SW_POLL_ITEM_VIEW_CLASS (klass);
   GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (SwPlurkItemViewPrivate));
 
   object_class->get_property = sw_plurk_item_view_get_property;
   object_class->set_property = sw_plurk_item_view_set_property;
-  object_class->dispose = sw_plurk_item_view_dispose;
   object_class->finalize = sw_plurk_item_view_finalize;
-  object_class->constructed = sw_plurk_item_view_constructed;
-
-  item_view_class->start = plurk_item_view_start;
-  item_view_class->stop = plurk_item_view_stop;
-  item_view_class->refresh = plurk_item_view_refresh;
 
-  pspec = g_param_spec_object ("proxy",
-                               "proxy",
-                               "proxy",
-                               REST_TYPE_PROXY,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PROXY, pspec);
+  poll_class->info = &plurk_info;
+  poll_class->prepare_call = plurk_item_view_prepare_call;
+  poll_class->parse_page = plurk_item_view_parse_page;
+  poll_class->call_failed = plurk_item_view_call_failed;
+  poll_class->fetch_finished = plurk_item_view_fetch_finished;
+  poll_class->user_changed = plurk_item_view_user_changed;
+  poll_class->is_pushed = plurk_item_view_is_pushed;
+  poll_class->polling_changed = plurk_item_view_polling_changed;
 
   pspec = g_param_spec_string ("api_key",
                                "api_key",
@@ -560,20 +605,6 @@ sw_plurk_item_view_class_init (SwPlurkItemViewClass *klass)
                                NULL,
                                G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
   g_object_class_install_property (object_class, PROP_APIKEY, pspec);
-
-  pspec = g_param_spec_string ("query",
-                               "query",
-                               "query",
-                               NULL,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_QUERY, pspec);
-
-  pspec = g_param_spec_boxed ("params",
-                              "params",
-                              "params",
-                              G_TYPE_HASH_TABLE,
-                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PARAMS, pspec);
 }
 
 static void
@@ -581,4 +612,7 @@ sw_plurk_item_view_init (SwPlurkItemView *self)
 {
   SwPlurkItemViewPrivate *priv = GET_PRIVATE (self);
   priv->api_key = NULL;
+  priv->users = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                       NULL, (GDestroyNotify)plurk_user_free);
+  priv->seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
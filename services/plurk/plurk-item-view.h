@@ -23,7 +23,7 @@
 #define _SW_PLURK_ITEM_VIEW
 
 #include <glib-object.h>
-#include <libsocialweb/sw-item-view.h>
+#include "poll-item-view.h"
 
 G_BEGIN_DECLS
 
@@ -45,11 +45,11 @@ G_BEGIN_DECLS
   (G_TYPE_INSTANCE_GET_CLASS ((obj), SW_TYPE_PLURK_ITEM_VIEW, SwPlurkItemViewClass))
 
 typedef struct {
-  SwItemView parent;
+  SwPollItemView parent;
 } SwPlurkItemView;
 
 typedef struct {
-  SwItemViewClass parent_class;
+  SwPollItemViewClass parent_class;
 } SwPlurkItemViewClass;
 
 GType sw_plurk_item_view_get_type (void);
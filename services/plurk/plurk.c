@@ -48,6 +48,11 @@
 
 #include "plurk.h"
 #include "plurk-item-view.h"
+#include "session-store.h"
+#include "outbox.h"
+#include "http-session.h"
+#include "circuit-breaker.h"
+#include "rate-governor.h"
 
 static void initable_iface_init (gpointer g_iface, gpointer iface_data);
 static void query_iface_init (gpointer g_iface, gpointer iface_data);
@@ -69,28 +74,49 @@ G_DEFINE_TYPE_WITH_CODE (SwServicePlurk,
 #define GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_SERVICE_PLURK, SwServicePlurkPrivate))
 
+#define PLURK_API_URL "http://www.plurk.com/API/"
+
+/* How long a session is reused if the cookies don't say otherwise */
+#define PLURK_SESSION_LIFETIME (24 * 60 * 60)
+
+/* Plurk allows 50000 calls a day per API key and sends no rate-limit headers */
+#define PLURK_HOURLY_LIMIT 2000
+
 struct _SwServicePlurkPrivate {
   gboolean inited;
+  guint init_id;
+  gboolean activated;
   enum {
     OFFLINE,
     CREDS_INVALID,
     CREDS_VALID
   } credentials;
   RestProxy *proxy;
+  SoupCookieJar *cookie_jar;
+  gboolean logging_in;
   char *user_id;
   char *image_url;
   char *username, *password;
   char *api_key;
+  Outbox *outbox;
+  SwPlurkComet *comet;
 };
 
 static void online_notify (gboolean online, gpointer user_data);
 static void credentials_updated (SwService *service);
+static RestProxyCall *make_status_call (const char *msg, gpointer user_data);
+static OutboxResult status_sent_cb (const char    *msg,
+                                    RestProxyCall *call,
+                                    const GError  *error,
+                                    gpointer       user_data);
+static void _comet_session_rejected_cb (SwPlurkComet   *comet,
+                                        SwServicePlurk *plurk);
 
 static JsonNode *
 node_from_call (RestProxyCall *call, JsonParser *parser)
 {
   JsonNode *root;
-  GError *error;
+  GError *error = NULL;
   gboolean ret = FALSE;
 
   if (call == NULL)
@@ -109,6 +135,9 @@ node_from_call (RestProxyCall *call, JsonParser *parser)
                                     &error);
   root = json_parser_get_root (parser);
 
+  if (error)
+    g_error_free (error);
+
   if (root == NULL) {
     g_message ("Error from Plurk: %s",
                rest_proxy_call_get_payload (call));
@@ -128,7 +157,8 @@ construct_image_url (const char *uid,
   if (has_profile == 1 && avatar <= 0)
     url = g_strdup_printf ("http://avatars.plurk.com/%s-medium.gif", uid);
   else if (has_profile == 1 && avatar > 0)
-    url = g_strdup_printf ("http://avatars.plurk.com/%s-medium%lld.gif", uid, avatar);
+    url = g_strdup_printf ("http://avatars.plurk.com/%s-medium%" G_GINT64_FORMAT
+                           ".gif", uid, avatar);
   else
     url = g_strdup_printf ("http://www.plurk.com/static/default_medium.gif");
 
@@ -179,7 +209,7 @@ get_dynamic_caps (SwService *service)
   /* Check the conditions and determine which caps array to return */
   switch (priv->credentials) {
   case CREDS_VALID:
-    return full_caps;
+    return circuit_breaker_get_caps (priv->proxy, full_caps);
   case CREDS_INVALID:
     return invalid_caps;
   case OFFLINE:
@@ -219,12 +249,105 @@ construct_user_data (SwServicePlurk* plurk, JsonNode *root)
 
   has_profile = json_object_get_int_member (object, "has_profile_image");
 
-  uid = g_strdup_printf ("%lld", id);
+  uid = g_strdup_printf ("%" G_GINT64_FORMAT, id);
 
   priv->user_id = (char *) uid;
   priv->image_url = construct_image_url (uid, avatar, has_profile);
 }
 
+static void
+clear_session (SwServicePlurk *plurk)
+{
+  SwServicePlurkPrivate *priv = GET_PRIVATE (plurk);
+  GSList *cookies, *l;
+
+  g_free (priv->user_id);
+  priv->user_id = NULL;
+  g_free (priv->image_url);
+  priv->image_url = NULL;
+
+  cookies = soup_cookie_jar_all_cookies (priv->cookie_jar);
+  for (l = cookies; l; l = l->next)
+    soup_cookie_jar_delete_cookie (priv->cookie_jar, l->data);
+  soup_cookies_free (cookies);
+}
+
+/*
+ * Store the session cookies with the user details so that the next online
+ * transition, or the next daemon run, can skip Users/login.  The session
+ * expires with the first cookie that does.
+ */
+static void
+save_session (SwServicePlurk *plurk)
+{
+  SwServicePlurkPrivate *priv = GET_PRIVATE (plurk);
+  SoupURI *uri;
+  GSList *cookies, *l;
+  char *header;
+  time_t expires, t;
+
+  uri = soup_uri_new (PLURK_API_URL);
+  header = soup_cookie_jar_get_cookies (priv->cookie_jar, uri, TRUE);
+  soup_uri_free (uri);
+
+  if (header == NULL)
+    return;
+
+  expires = time (NULL) + PLURK_SESSION_LIFETIME;
+  cookies = soup_cookie_jar_all_cookies (priv->cookie_jar);
+  for (l = cookies; l; l = l->next) {
+    SoupCookie *cookie = l->data;
+
+    if (cookie->expires == NULL)
+      continue;
+
+    t = soup_date_to_time_t (cookie->expires);
+    if (t < expires)
+      expires = t;
+  }
+  soup_cookies_free (cookies);
+
+  session_store_save ("plurk", priv->username, expires,
+                      "user_id", priv->user_id,
+                      "image_url", priv->image_url,
+                      "cookies", header,
+                      NULL);
+  g_free (header);
+}
+
+static gboolean
+restore_session (SwServicePlurk *plurk)
+{
+  SwServicePlurkPrivate *priv = GET_PRIVATE (plurk);
+  SoupURI *uri;
+  char *user_id, *image_url, *header;
+  char **cookies;
+  gboolean found;
+  gint i;
+
+  found = session_store_lookup ("plurk", priv->username,
+                                "user_id", &user_id,
+                                "image_url", &image_url,
+                                "cookies", &header,
+                                NULL);
+
+  if (!found)
+    return FALSE;
+
+  uri = soup_uri_new (PLURK_API_URL);
+  cookies = g_strsplit (header, "; ", 0);
+  for (i = 0; cookies[i]; i++)
+    soup_cookie_jar_set_cookie (priv->cookie_jar, uri, cookies[i]);
+  g_strfreev (cookies);
+  soup_uri_free (uri);
+  g_free (header);
+
+  priv->user_id = user_id;
+  priv->image_url = image_url;
+
+  return TRUE;
+}
+
 static void
 _got_login_data (RestProxyCall *call,
                  const GError  *error,
@@ -233,31 +356,62 @@ _got_login_data (RestProxyCall *call,
 {
   SwService *service = SW_SERVICE (weak_object);
   SwServicePlurk *plurk = SW_SERVICE_PLURK (service);
+  SwServicePlurkPrivate *priv = plurk->priv;
   JsonParser *parser = NULL;
   JsonNode *root;
 
+  priv->logging_in = FALSE;
+
   if (error) {
     // TODO sanity_check_date (call);
     g_message ("Error: %s", error->message);
 
-    plurk->priv->credentials = CREDS_INVALID;
+    priv->credentials = CREDS_INVALID;
     sw_service_emit_capabilities_changed (service, get_dynamic_caps (service));
 
+    g_object_unref (call);
     return;
   }
 
-  plurk->priv->credentials = CREDS_VALID;
-
   parser = json_parser_new ();
   root = node_from_call (call, parser);
-  construct_user_data (plurk, root);
-  g_object_unref (root);
+  if (root)
+    construct_user_data (plurk, root);
+  g_object_unref (parser);
+
+  if (priv->user_id) {
+    priv->credentials = CREDS_VALID;
+    save_session (plurk);
+  } else {
+    priv->credentials = CREDS_INVALID;
+  }
 
   sw_service_emit_capabilities_changed (service, get_dynamic_caps (service));
 
   g_object_unref (call);
 }
 
+static void
+login (SwServicePlurk *plurk)
+{
+  SwServicePlurkPrivate *priv = GET_PRIVATE (plurk);
+  RestProxyCall *call;
+
+  if (priv->logging_in)
+    return;
+
+  priv->logging_in = TRUE;
+
+  call = rest_proxy_new_call (priv->proxy);
+  rest_proxy_call_set_function (call, "Users/login");
+  rest_proxy_call_add_params (call,
+                              "api_key", priv->api_key,
+                              "username", priv->username,
+                              "password", priv->password,
+                              NULL);
+  rest_proxy_call_async (call, _got_login_data, (GObject*)plurk, NULL, NULL);
+}
+
 static void
 online_notify (gboolean online, gpointer user_data)
 {
@@ -268,26 +422,72 @@ online_notify (gboolean online, gpointer user_data)
 
   if (online) {
     if (priv->username && priv->password) {
-      RestProxyCall *call;
-
-      call = rest_proxy_new_call (priv->proxy);
-      rest_proxy_call_set_function (call, "Users/login");
-      rest_proxy_call_add_params (call,
-                                  "api_key", priv->api_key,
-                                  "username", priv->username,
-                                  "password", priv->password,
-                                  NULL);
-      rest_proxy_call_async (call, _got_login_data, (GObject*)plurk, NULL, NULL);
+      /* Reuse the session we have, or the one from the last run */
+      if (priv->user_id || restore_session (plurk)) {
+        priv->credentials = CREDS_VALID;
+        sw_service_emit_capabilities_changed ((SwService *)plurk,
+                                              get_dynamic_caps ((SwService *)plurk));
+      } else if (priv->activated) {
+        login (plurk);
+      }
     }
   } else {
-    g_free (priv->user_id);
-    priv->user_id = NULL;
-
     sw_service_emit_capabilities_changed ((SwService *)plurk,
                                           get_dynamic_caps ((SwService *)plurk));
   }
 }
 
+/*
+ * Whether @call failed because the session is no longer valid.  Plurk answers
+ * with 400 and "Requires login" for that rather than 401.
+ */
+gboolean
+sw_service_plurk_session_rejected (RestProxyCall *call)
+{
+  const char *payload;
+
+  switch (rest_proxy_call_get_status_code (call)) {
+  case SOUP_STATUS_UNAUTHORIZED:
+    return TRUE;
+  case SOUP_STATUS_BAD_REQUEST:
+    payload = rest_proxy_call_get_payload (call);
+    return payload && g_strstr_len (payload,
+                                    rest_proxy_call_get_payload_length (call),
+                                    "Requires login") != NULL;
+  default:
+    return FALSE;
+  }
+}
+
+/*
+ * Plurk rejected the session cookie, so forget the session and log in again.
+ */
+void
+sw_service_plurk_invalidate_session (SwServicePlurk *plurk)
+{
+  SwServicePlurkPrivate *priv = GET_PRIVATE (plurk);
+
+  clear_session (plurk);
+  session_store_forget ("plurk");
+
+  if (priv->credentials != CREDS_VALID)
+    return;
+
+  priv->credentials = OFFLINE;
+  sw_service_emit_capabilities_changed ((SwService *)plurk,
+                                        get_dynamic_caps ((SwService *)plurk));
+
+  if (sw_is_online ())
+    online_notify (TRUE, plurk);
+}
+
+/* The realtime channel shared by the service's views */
+SwPlurkComet *
+sw_service_plurk_get_comet (SwServicePlurk *plurk)
+{
+  return GET_PRIVATE (plurk)->comet;
+}
+
 /*
  * Callback from the keyring lookup in refresh_credentials.
  */
@@ -303,12 +503,24 @@ found_password_cb (GnomeKeyringResult  result,
   if (result == GNOME_KEYRING_RESULT_OK && list != NULL) {
     GnomeKeyringNetworkPasswordData *data = list->data;
 
+    /* Nothing to do if the account didn't change and is logged in */
+    if (g_strcmp0 (priv->username, data->user) == 0 &&
+        g_strcmp0 (priv->password, data->password) == 0 &&
+        priv->credentials == CREDS_VALID)
+      return;
+
+    /* A stored session belongs to the account it was made with */
+    if (priv->username)
+      session_store_forget ("plurk");
+
     g_free (priv->username);
     g_free (priv->password);
 
     priv->username = g_strdup (data->user);
     priv->password = g_strdup (data->password);
 
+    clear_session (plurk);
+
     /* If we're online, force a reconnect to fetch new credentials */
     if (sw_is_online ()) {
       online_notify (FALSE, service);
@@ -321,6 +533,8 @@ found_password_cb (GnomeKeyringResult  result,
     priv->password = NULL;
     priv->credentials = OFFLINE;
 
+    clear_session (plurk);
+
     if (result != GNOME_KEYRING_RESULT_NO_MATCH) {
       g_warning (G_STRLOC ": Error getting password: %s", gnome_keyring_result_to_message (result));
     }
@@ -342,6 +556,9 @@ refresh_credentials (SwServicePlurk *plurk)
 static void
 credentials_updated (SwService *service)
 {
+  /* The user just changed the account, so verify it straight away */
+  GET_PRIVATE (service)->activated = TRUE;
+
   refresh_credentials (SW_SERVICE_PLURK (service));
 }
 
@@ -358,12 +575,34 @@ sw_service_plurk_dispose (GObject *object)
 
   sw_online_remove_notify (online_notify, object);
 
+  if (priv->init_id) {
+    g_source_remove (priv->init_id);
+    priv->init_id = 0;
+  }
+
+  if (priv->outbox) {
+    outbox_free (priv->outbox);
+    priv->outbox = NULL;
+  }
+
+  if (priv->comet) {
+    g_signal_handlers_disconnect_by_func (priv->comet,
+                                          _comet_session_rejected_cb, object);
+    g_object_unref (priv->comet);
+    priv->comet = NULL;
+  }
+
   /* unref private variables */
   if (priv->proxy) {
     g_object_unref (priv->proxy);
     priv->proxy = NULL;
   }
 
+  if (priv->cookie_jar) {
+    g_object_unref (priv->cookie_jar);
+    priv->cookie_jar = NULL;
+  }
+
   G_OBJECT_CLASS (sw_service_plurk_parent_class)->dispose (object);
 }
 
@@ -405,6 +644,60 @@ sw_service_plurk_init (SwServicePlurk *self)
   self->priv->inited = FALSE;
 }
 
+/*
+ * The keyring lookups are deferred to an idle so that the daemon can load
+ * every module first and the lookups of all services run concurrently.
+ */
+static gboolean
+deferred_init_cb (gpointer user_data)
+{
+  SwServicePlurk *plurk = SW_SERVICE_PLURK (user_data);
+
+  plurk->priv->init_id = 0;
+  refresh_credentials (plurk);
+
+  return FALSE;
+}
+
+/*
+ * Logging in waits until a client actually needs the service, so a cold
+ * start doesn't pay for logins nobody asked for.
+ */
+static void
+activate (SwServicePlurk *plurk)
+{
+  SwServicePlurkPrivate *priv = GET_PRIVATE (plurk);
+
+  if (priv->activated)
+    return;
+
+  priv->activated = TRUE;
+
+  if (sw_is_online () && priv->credentials != CREDS_VALID)
+    online_notify (TRUE, plurk);
+}
+
+static void
+_capabilities_changed_cb (SwService    *service,
+                          const gchar **caps,
+                          gpointer      user_data)
+{
+  SwServicePlurkPrivate *priv = GET_PRIVATE (service);
+
+  outbox_set_ready (priv->outbox,
+                    sw_service_has_cap (caps, CREDENTIALS_VALID));
+  /* A new login gets a new channel */
+  sw_plurk_comet_set_ready (priv->comet,
+                            sw_service_has_cap (caps, CREDENTIALS_VALID));
+}
+
+static void
+_comet_session_rejected_cb (SwPlurkComet   *comet,
+                            SwServicePlurk *plurk)
+{
+  sw_service_plurk_invalidate_session (plurk);
+}
+
 /* Initable interface */
 
 static gboolean
@@ -434,11 +727,32 @@ sw_service_plurk_initable (GInitable    *initable,
 
   priv->credentials = OFFLINE;
 
-  priv->proxy = rest_proxy_new ("http://www.plurk.com/API/", FALSE); 
+  priv->proxy = rest_proxy_new (PLURK_API_URL, FALSE);
+  http_session_setup (priv->proxy, "plurk");
+  circuit_breaker_attach (priv->proxy, SW_SERVICE (plurk));
+  rate_governor_attach (priv->proxy, PLURK_HOURLY_LIMIT);
+
+  /* Plurk keeps the login session in a cookie */
+  priv->cookie_jar = soup_cookie_jar_new ();
+  rest_proxy_add_soup_feature (priv->proxy,
+                               SOUP_SESSION_FEATURE (priv->cookie_jar));
+
+  priv->comet = sw_plurk_comet_new (priv->proxy, priv->api_key);
+  g_signal_connect (priv->comet, "session-rejected",
+                    G_CALLBACK (_comet_session_rejected_cb), plurk);
+
+  priv->outbox = outbox_new ("plurk", G_OBJECT (plurk),
+                             make_status_call, status_sent_cb, plurk);
+  g_signal_connect (plurk, "capabilities-changed",
+                    G_CALLBACK (_capabilities_changed_cb), NULL);
+
+  /* Updates left over from the last run need a login to go out */
+  if (!outbox_is_empty (priv->outbox))
+    priv->activated = TRUE;
 
   sw_online_add_notify (online_notify, plurk);
 
-  refresh_credentials (plurk);
+  priv->init_id = g_idle_add (deferred_init_cb, plurk);
 
   priv->inited = TRUE;
 
@@ -493,6 +807,8 @@ _plurk_query_open_view (SwQueryIface          *self,
     return;
   }
 
+  activate (SW_SERVICE_PLURK (self));
+
   item_view = g_object_new (SW_TYPE_PLURK_ITEM_VIEW,
                             "proxy", priv->proxy,
                             "api_key", priv->api_key,
@@ -538,6 +854,8 @@ _plurk_avatar_request_avatar (SwAvatarIface         *self,
 {
   SwServicePlurkPrivate *priv = GET_PRIVATE (self);
 
+  activate (SW_SERVICE_PLURK (self));
+
   if (priv->image_url) {
     sw_web_download_image_async (priv->image_url,
                                  _requested_avatar_downloaded_cb,
@@ -559,20 +877,71 @@ avatar_iface_init (gpointer g_iface,
 }
 
 /* Status Update interface */
-static void
-_update_status_cb (RestProxyCall *call,
-                   const GError  *error,
-                   GObject       *weak_object,
-                   gpointer       userdata)
+static RestProxyCall *
+make_status_call (const char *msg,
+                  gpointer    user_data)
 {
-  if (error)
-  {
+  SwServicePlurkPrivate *priv = GET_PRIVATE (user_data);
+  RestProxyCall *call;
+
+  if (!priv->user_id ||
+      !rate_governor_acquire (priv->proxy, RATE_PRIORITY_REQUEST, 1))
+    return NULL;
+
+  call = rest_proxy_new_call (priv->proxy);
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_set_function (call, "Timeline/plurkAdd");
+
+  rest_proxy_call_add_params (call,
+                              "api_key", priv->api_key,
+                              "content", msg,
+                              "qualifier", ":",
+                              NULL);
+
+  return call;
+}
+
+static OutboxResult
+status_sent_cb (const char    *msg,
+                RestProxyCall *call,
+                const GError  *error,
+                gpointer       user_data)
+{
+  OutboxResult result;
+
+  rate_governor_update (GET_PRIVATE (user_data)->proxy, call);
+
+  if (sw_service_plurk_session_rejected (call)) {
+    /* Held back until the new login is in place */
+    sw_service_plurk_invalidate_session (SW_SERVICE_PLURK (user_data));
+    return OUTBOX_HOLD;
+  }
+
+  result = outbox_classify (call, error);
+
+  switch (result) {
+  case OUTBOX_SENT:
+    sw_status_update_iface_emit_status_updated (user_data, TRUE);
+    break;
+  case OUTBOX_RETRY:
+    g_message ("Error updating status, will retry: %s", error->message);
+    break;
+  case OUTBOX_DROP:
     g_critical (G_STRLOC ": Error updating status: %s",
                 error->message);
-    sw_status_update_iface_emit_status_updated (weak_object, FALSE);
-  } else {
-    sw_status_update_iface_emit_status_updated (weak_object, TRUE);
+    sw_status_update_iface_emit_status_updated (user_data, FALSE);
+    break;
+  case OUTBOX_UNKNOWN:
+    g_message ("Status update may not have been posted: %s", error->message);
+    sw_status_update_iface_emit_status_updated (user_data, FALSE);
+    break;
+  case OUTBOX_HOLD:
+    g_message ("Status update held until the login is renewed: %s",
+               error->message);
+    break;
   }
+
+  return result;
 }
 
 static void
@@ -583,22 +952,11 @@ _plurk_status_update_update_status (SwStatusUpdateIface   *self,
 {
   SwServicePlurk *plurk = SW_SERVICE_PLURK (self);
   SwServicePlurkPrivate *priv = GET_PRIVATE (plurk);
-  RestProxyCall *call;
 
-  if (!priv->user_id)
-    return;
-
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_method (call, "POST");
-  rest_proxy_call_set_function (call, "Timeline/plurkAdd");
-
-  rest_proxy_call_add_params (call,
-                              "api_key", priv->api_key,
-                              "content", msg,
-                              "qualifier", ":",
-                              NULL);
+  activate (plurk);
 
-  rest_proxy_call_async (call, _update_status_cb, (GObject *)self, NULL, NULL);
+  /* Queued so that nothing is lost while offline or logging in */
+  outbox_push (priv->outbox, msg);
   sw_status_update_iface_return_from_update_status (context);
 }
 
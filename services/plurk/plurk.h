@@ -23,6 +23,9 @@
 #define _SW_SERVICE_PLURK
 
 #include <libsocialweb/sw-service.h>
+#include <rest/rest-proxy-call.h>
+
+#include "plurk-comet.h"
 
 G_BEGIN_DECLS
 
@@ -56,6 +59,10 @@ typedef struct {
 
 GType sw_service_plurk_get_type (void);
 
+gboolean sw_service_plurk_session_rejected (RestProxyCall *call);
+void sw_service_plurk_invalidate_session (SwServicePlurk *plurk);
+SwPlurkComet *sw_service_plurk_get_comet (SwServicePlurk *plurk);
+
 G_END_DECLS
 
 #endif /* _SW_SERVICE_PLURK */
@@ -26,502 +26,363 @@
 #include <string.h>
 
 #include <rest/rest-proxy.h>
-#include <rest/rest-xml-parser.h>
 #include <libsoup/soup.h>
 
 #include <libsocialweb/sw-utils.h>
 #include <libsocialweb/sw-debug.h>
 #include <libsocialweb/sw-item.h>
-#include <libsocialweb/sw-cache.h>
 
 #include "utils.h"
+#include "json-scan.h"
 
 #include "sina-item-view.h"
+#include "sina.h"
 
 G_DEFINE_TYPE (SwSinaItemView,
                sw_sina_item_view,
-               SW_TYPE_ITEM_VIEW)
-
-#define GET_PRIVATE(o) \
-  (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_SINA_ITEM_VIEW, SwSinaItemViewPrivate))
-
-typedef struct _SwSinaItemViewPrivate SwSinaItemViewPrivate;
-
-struct _SwSinaItemViewPrivate {
-  RestProxy *proxy;
-  guint timeout_id;
-  GHashTable *params;
-  gchar *query;
+               SW_TYPE_POLL_ITEM_VIEW)
+
+#define USER_TIMELINE "statuses/user_timeline.json"
+#define FRIENDS_TIMELINE "statuses/friends_timeline.json"
+
+typedef struct {
+  char *id;
+  char *screen_name;
+  char *profile_image_url;
+} SinaUser;
+
+/* The members of a status that make up an item */
+typedef struct {
+  char *id;
+  char *created_at;
+  char *text;
+  SinaUser *user;
+} SinaStatus;
+
+static const PollItemViewInfo sina_info = {
+  .name = "sina",
+  .endpoint = NULL,
+  .default_page_size = 10,
+  .max_page_size = 200,
+  .max_pages = 10,
+  .count_param = "count",
+  .page_param = "page",
+  .paging = POLL_PAGING_NUMBER,
+  .first_page = 1
 };
 
-enum
+static char*
+make_date (const char *s)
 {
-  PROP_0,
-  PROP_PROXY,
-  PROP_PARAMS,
-  PROP_QUERY
-};
-
-#define UPDATE_TIMEOUT 5 * 60
-
-static void _service_item_hidden_cb (SwService   *service,
-                                     const gchar *uid,
-                                     SwItemView  *item_view);
-static void _service_user_changed_cb (SwService  *service,
-                                      SwItemView *item_view);
-static void _service_capabilities_changed_cb (SwService    *service,
-                                              const gchar **caps,
-                                              SwItemView   *item_view);
+  struct tm tm = {0};
+  strptime (s, "%A %h %d %T %z %Y", &tm);
+  return sw_time_t_to_string (mktime (&tm));
+}
 
 static void
-sw_sina_item_view_get_property (GObject    *object,
-                                guint       property_id,
-                                GValue     *value,
-                                GParamSpec *pspec)
+sina_user_free (SinaUser *user)
 {
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (object);
-
-  switch (property_id) {
-    case PROP_PROXY:
-      g_value_set_object (value, priv->proxy);
-      break;
-    case PROP_PARAMS:
-      g_value_set_boxed (value, priv->params);
-      break;
-    case PROP_QUERY:
-      g_value_set_string (value, priv->query);
-      break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
-  }
+  g_free (user->id);
+  g_free (user->screen_name);
+  g_free (user->profile_image_url);
+  g_slice_free (SinaUser, user);
 }
 
+/* Take the string or number just scanned as text, if that's what it was */
 static void
-sw_sina_item_view_set_property (GObject      *object,
-                                guint         property_id,
-                                const GValue *value,
-                                GParamSpec   *pspec)
+take_text (JsonScan      *scan,
+           JsonScanToken  token,
+           char         **text)
 {
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (object);
+  if (token != JSON_SCAN_STRING && token != JSON_SCAN_NUMBER)
+    return;
 
-  switch (property_id) {
-    case PROP_PROXY:
-      if (priv->proxy)
-      {
-        g_object_unref (priv->proxy);
-      }
-      priv->proxy = g_value_dup_object (value);
-      break;
-    case PROP_PARAMS:
-      priv->params = g_value_dup_boxed (value);
-      break;
-    case PROP_QUERY:
-      priv->query = g_value_dup_string (value);
-      break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
-  }
+  g_free (*text);
+  *text = g_strdup (json_scan_text (scan));
 }
 
-static void
-sw_sina_item_view_dispose (GObject *object)
+/*
+ * Read a user object.  Every status carries its author in full, so once the
+ * id shows a user already seen on this page the rest is skipped and the
+ * first copy is used.
+ */
+static SinaUser *
+scan_user (JsonScan   *scan,
+           GHashTable *users)
 {
-  SwItemView *item_view = SW_ITEM_VIEW (object);
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (object);
+  SinaUser *user, *seen;
+  JsonScanToken token;
+  char *key;
+
+  user = g_slice_new0 (SinaUser);
+
+  while ((token = json_scan_next (scan)) == JSON_SCAN_KEY) {
+    key = g_strdup (json_scan_text (scan));
+    token = json_scan_next (scan);
+
+    if (g_str_equal (key, "id")) {
+      take_text (scan, token, &user->id);
+      seen = user->id ? g_hash_table_lookup (users, user->id) : NULL;
+      if (seen) {
+        g_free (key);
+        sina_user_free (user);
+        return json_scan_finish (scan) ? seen : NULL;
+      }
+    } else if (g_str_equal (key, "screen_name")) {
+      take_text (scan, token, &user->screen_name);
+    } else if (g_str_equal (key, "profile_image_url")) {
+      take_text (scan, token, &user->profile_image_url);
+    } else if (!json_scan_skip (scan, token)) {
+      token = JSON_SCAN_ERROR;
+    }
 
-  if (priv->proxy) {
-    g_object_unref (priv->proxy);
-    priv->proxy = NULL;
+    g_free (key);
+    if (token == JSON_SCAN_ERROR)
+      break;
   }
 
-  if (priv->timeout_id) {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
+  if (token != JSON_SCAN_END_OBJECT || user->id == NULL) {
+    sina_user_free (user);
+    return NULL;
   }
 
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_item_hidden_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_user_changed_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_capabilities_changed_cb,
-                                        item_view);
-
-  G_OBJECT_CLASS (sw_sina_item_view_parent_class)->dispose (object);
+  g_hash_table_insert (users, user->id, user);
+  return user;
 }
 
-static void
-sw_sina_item_view_finalize (GObject *object)
+/* Read a status object up to its end, keeping only what make_item uses */
+static gboolean
+scan_status (JsonScan   *scan,
+             GHashTable *users,
+             SinaStatus *status)
 {
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (object);
-
-  /* free private variables */
-  g_free (priv->query);
-  g_hash_table_unref (priv->params);
+  JsonScanToken token;
+  char *key;
+
+  while ((token = json_scan_next (scan)) == JSON_SCAN_KEY) {
+    key = g_strdup (json_scan_text (scan));
+    token = json_scan_next (scan);
+
+    if (g_str_equal (key, "id"))
+      take_text (scan, token, &status->id);
+    else if (g_str_equal (key, "created_at"))
+      take_text (scan, token, &status->created_at);
+    else if (g_str_equal (key, "text"))
+      take_text (scan, token, &status->text);
+    else if (g_str_equal (key, "user") && token == JSON_SCAN_BEGIN_OBJECT)
+      status->user = scan_user (scan, users);
+    else if (!json_scan_skip (scan, token))
+      token = JSON_SCAN_ERROR;
+
+    g_free (key);
+    if (token == JSON_SCAN_ERROR)
+      return FALSE;
+  }
 
-  G_OBJECT_CLASS (sw_sina_item_view_parent_class)->finalize (object);
+  return token == JSON_SCAN_END_OBJECT;
 }
 
-static char*
-make_date (const char *s)
+static void
+sina_status_clear (SinaStatus *status)
 {
-  struct tm tm = {0};
-  strptime (s, "%A %h %d %T %z %Y", &tm);
-  return sw_time_t_to_string (mktime (&tm));
+  g_free (status->id);
+  g_free (status->created_at);
+  g_free (status->text);
+  memset (status, 0, sizeof (SinaStatus));
 }
 
-static void
-_populate_set_from_node (SwService   *service,
-                         SwSet       *set,
-                         RestXmlNode *root)
+static SwItem *
+make_item (SwService  *service,
+           SinaStatus *status)
 {
-  RestXmlNode *node;
+  SwItem *item;
 
-  if (!root)
-    return;
-
-  node = rest_xml_node_find (root, "status");
-  while (node) {
-    SwItem *item;
-    RestXmlNode *user;
-    char *id, *date, *uid, *url;
-
-    item = sw_item_new ();
-    sw_item_set_service (item, service);
-
-    user = rest_xml_node_find (node, "user");
+  item = sw_item_new ();
+  sw_item_set_service (item, service);
 
-    id = g_strconcat ("sina-",
-                      xml_get_child_node_value (node, "id"),
-                      NULL);
-    sw_item_take (item, "id", id);
+  sw_item_take (item, "id", g_strconcat ("sina-", status->id, NULL));
 
-    date = xml_get_child_node_value (node, "created_at");
-    sw_item_take (item, "date", make_date (date));
-    g_free (date);
+  if (status->created_at)
+    sw_item_take (item, "date", make_date (status->created_at));
 
-    sw_item_take (item,
-                  "author",
-                  xml_get_child_node_value (user, "screen_name"));
+  sw_item_put (item, "author", status->user->screen_name);
 
-    url = xml_get_child_node_value (user, "profile_image_url");
-    sw_item_request_image_fetch (item, FALSE, "authoricon", url);
-    g_free (url);
+  sw_item_request_image_fetch (item, FALSE, "authoricon",
+                               status->user->profile_image_url);
 
-    sw_item_take (item,
-                  "content",
-                  xml_get_child_node_value (node, "text"));
+  sw_item_put (item, "content", status->text);
 
-    uid = xml_get_child_node_value (user, "id");
-    url = g_strconcat ("http://t.sina.com.cn/", uid, NULL);
-    sw_item_take (item, "url", url);
-    g_free (uid);
+  sw_item_take (item, "url",
+                g_strconcat ("http://t.sina.com.cn/", status->user->id, NULL));
 
-    if (!sw_service_is_uid_banned (service, sw_item_get (item, "id"))) {
-      sw_set_add (set, G_OBJECT (item));
-    }
-    g_object_unref (item);
-
-    /* Next node */
-    node = node->next;
-  }
+  return item;
 }
 
-static void _get_user_status_updates (SwSinaItemView *item_view, SwSet *set);
-
-static void
-_got_user_status_cb (RestProxyCall *call,
-                     const GError  *error,
-                     GObject       *weak_object,
-                     gpointer       userdata)
+/*
+ * The timelines are an array of statuses, each with its author and, for a
+ * repost, the original status nested in it.  Only a handful of members are
+ * wanted, so the payload is scanned rather than parsed into a tree.
+ */
+static gint
+_populate_set_from_payload (SwPollItemView *view,
+                            SwService      *service,
+                            SwSet          *own,
+                            const char     *payload,
+                            gsize           length)
 {
-  SwSinaItemView *item_view = SW_SINA_ITEM_VIEW (weak_object);
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set = (SwSet *)userdata;
-  RestXmlNode *root;
-  SwService *service;
-
-  if (error) {
-    g_message ("Error: %s", error->message);
-    return;
+  JsonScan scan;
+  JsonScanToken token;
+  GHashTable *users;
+  GArray *statuses;
+  SinaStatus status = { NULL, }, *s;
+  gint count = -1;
+  guint i;
+
+  json_scan_init (&scan, payload, length);
+  users = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                 NULL, (GDestroyNotify)sina_user_free);
+  statuses = g_array_new (FALSE, FALSE, sizeof (SinaStatus));
+
+  /* Errors come back as an object instead */
+  if (json_scan_next (&scan) != JSON_SCAN_BEGIN_ARRAY)
+    goto out;
+
+  /* The whole page is scanned before any item is built */
+  while ((token = json_scan_next (&scan)) == JSON_SCAN_BEGIN_OBJECT) {
+    if (!scan_status (&scan, users, &status))
+      goto out;
+
+    g_array_append_val (statuses, status);
+    memset (&status, 0, sizeof (SinaStatus));
   }
 
-  service = sw_item_view_get_service (SW_ITEM_VIEW (item_view));
+  if (token != JSON_SCAN_END_ARRAY)
+    goto out;
 
-  root = xml_node_from_call (call, "Sina");
-  _populate_set_from_node (service, set, root);
-  rest_xml_node_unref (root);
+  sw_poll_item_view_mark_parsed (view);
+  count = statuses->len;
 
-  g_object_unref (call);
+  for (i = 0; i < statuses->len; i++) {
+    s = &g_array_index (statuses, SinaStatus, i);
 
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view), set);
+    if (s->id && s->user &&
+        !sw_poll_item_view_is_banned (view, "sina-", s->id)) {
+      SwItem *item = make_item (service, s);
 
-  /* Save the results of this set to the cache */
-  sw_cache_save (service,
-                 priv->query,
-                 priv->params,
-                 set);
-
-  sw_set_unref (set);
-}
-
-static void
-_got_friends_status_cb (RestProxyCall *call,
-                        const GError  *error,
-                        GObject       *weak_object,
-                        gpointer       userdata)
-{
-  SwSinaItemView *item_view = SW_SINA_ITEM_VIEW (weak_object);
-  SwSet *set = (SwSet *)userdata;
-  RestXmlNode *root;
-  SwService *service;
-
-  if (error) {
-    g_message ("Error: %s", error->message);
-    return;
+      if (own)
+        sw_set_add (own, (GObject *)item);
+      sw_poll_item_view_add_item (view, item);
+    }
   }
 
-  service = sw_item_view_get_service (SW_ITEM_VIEW (item_view));
-
-  root = xml_node_from_call (call, "sina");
-  _populate_set_from_node (service, set, root);
-  rest_xml_node_unref (root);
-
-  g_object_unref (call);
-
-  _get_user_status_updates (item_view, set);
-}
-
-static void
-_get_user_status_updates (SwSinaItemView *item_view,
-                          SwSet          *set)
-{
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (item_view);
-  RestProxyCall *call;
-
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_function (call, "statuses/user_timeline.xml");
-  rest_proxy_call_add_params(call,
-                             "count", "10",
-                             NULL);
-  rest_proxy_call_async (call, _got_user_status_cb, (GObject*)item_view, set, NULL);
-}
+ out:
+  sina_status_clear (&status);
+  for (i = 0; i < statuses->len; i++)
+    sina_status_clear (&g_array_index (statuses, SinaStatus, i));
+  g_array_free (statuses, TRUE);
+  g_hash_table_destroy (users);
+  json_scan_clear (&scan);
 
-static void
-_get_friends_status_updates (SwSinaItemView *item_view,
-                             SwSet          *set)
-{
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (item_view);
-  RestProxyCall *call;
-
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_function (call, "statuses/friends_timeline.xml");
-  rest_proxy_call_add_params(call,
-                             "count", "10",
-                             NULL);
-  rest_proxy_call_async (call, _got_friends_status_cb, (GObject*)item_view, set, NULL);
+  return count;
 }
 
-static void
-_get_status_updates (SwSinaItemView *item_view)
+static const char *
+sina_item_view_get_endpoint (SwPollItemView *view,
+                             guint           page,
+                             guint           step)
 {
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set;
-
-  set = sw_item_set_new ();
-
-  if (g_str_equal (priv->query, "own"))
-    _get_user_status_updates (item_view, set);
-  else if (g_str_equal (priv->query, "feed")) 
-    _get_friends_status_updates (item_view, set);
-  else
-    g_error (G_STRLOC ": Unexpected query '%s'", priv->query);
-}
-
-static gboolean
-_update_timeout_cb (gpointer data)
-{
-  SwSinaItemView *item_view = SW_SINA_ITEM_VIEW (data);
-
-  _get_status_updates (item_view);
-
-  return TRUE;
-}
-
-static void
-_load_from_cache (SwSinaItemView *item_view)
-{
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set;
-
-  set = sw_cache_load (sw_item_view_get_service (SW_ITEM_VIEW (item_view)),
-                       priv->query,
-                       priv->params);
-
-  if (set)
-  {
-    sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                               set);
-    sw_set_unref (set);
+  const char *query = sw_poll_item_view_get_query (view);
+
+  if (g_str_equal (query, "own"))
+    return step == 0 ? USER_TIMELINE : NULL;
+
+  if (g_str_equal (query, "feed")) {
+    /* The user's own statuses are only mixed into the first page */
+    if (step == 0)
+      return FRIENDS_TIMELINE;
+    else if (step == 1 && page == 0)
+      return USER_TIMELINE;
+    return NULL;
   }
-}
 
-static void
-sina_item_view_start (SwItemView *item_view)
-{
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View already started.");
-  } else {
-    priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                              (GSourceFunc)_update_timeout_cb,
-                                              item_view);
-    _load_from_cache ((SwSinaItemView *)item_view);
-    _get_status_updates ((SwSinaItemView *)item_view);
-  }
+  g_error (G_STRLOC ": Unexpected query '%s'", query);
+  return NULL;
 }
 
-static void
-sina_item_view_stop (SwItemView *item_view)
+static gint
+sina_item_view_parse_page (SwPollItemView *view,
+                           RestProxyCall  *call,
+                           const char     *endpoint)
 {
-  SwSinaItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (!priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View not running");
-  } else {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
+  SwService *service;
+  SwSet *own = NULL;
+  gint length;
+
+  if (!SOUP_STATUS_IS_SUCCESSFUL (rest_proxy_call_get_status_code (call))) {
+    g_message ("Error from Sina: %s (%d)",
+               rest_proxy_call_get_status_message (call),
+               rest_proxy_call_get_status_code (call));
+    return -1;
   }
-}
 
-static void
-sina_item_view_refresh (SwItemView *item_view)
-{
-  _get_status_updates ((SwSinaItemView *)item_view);
-}
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
 
-static void
-_service_item_hidden_cb (SwService   *service,
-                         const gchar *uid,
-                         SwItemView  *item_view)
-{
-  sw_item_view_remove_by_uid (item_view, uid);
-}
+  /* The feed fetches the first page of the own timeline too, so share it */
+  if (g_str_equal (sw_poll_item_view_get_query (view), "feed") &&
+      g_str_equal (endpoint, USER_TIMELINE) &&
+      sw_poll_item_view_get_page (view) == 0)
+    own = sw_item_set_new ();
 
-static void
-_service_user_changed_cb (SwService  *service,
-                          SwItemView *item_view)
-{
-  SwSet *set;
+  length = _populate_set_from_payload (view, service, own,
+                                       rest_proxy_call_get_payload (call),
+                                       rest_proxy_call_get_payload_length (call));
+  if (length < 0)
+    g_message ("Error from Sina: %s", rest_proxy_call_get_payload (call));
+  else if (own)
+    sw_service_sina_set_own_timeline (SW_SERVICE_SINA (service), own,
+                                      sw_poll_item_view_get_page_size (view));
 
-  /* We need to empty the set */
-  set = sw_item_set_new ();
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                             set);
-  sw_set_unref (set);
+  if (own)
+    sw_set_unref (own);
 
-  /* And drop the cache */
-  sw_cache_drop_all (service);
+  return length;
 }
 
-static void
-_service_capabilities_changed_cb (SwService    *service,
-                                  const gchar **caps,
-                                  SwItemView   *item_view)
-{
-  SwSinaItemViewPrivate *priv = GET_PRIVATE ((SwSinaItemView*) item_view);
-
-  if (sw_service_has_cap (caps, CREDENTIALS_VALID))
-  {
-    sina_item_view_refresh (item_view);
-
-    if (!priv->timeout_id)
-    {
-      priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                                (GSourceFunc)_update_timeout_cb,
-                                                item_view);
-    }
-  } else {
-    if (priv->timeout_id)
-    {
-      g_source_remove (priv->timeout_id);
-      priv->timeout_id = 0;
-    }
-  }
-}
-
-static void
-sw_sina_item_view_constructed (GObject *object)
+/* Serve "own" from the page the feed fetched last, if that's all it wants */
+static gboolean
+sina_item_view_fetch_local (SwPollItemView *view)
 {
-  SwItemView *item_view = SW_ITEM_VIEW (object);
+  SwService *service;
+  SwSet *set;
 
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "item-hidden",
-                    (GCallback)_service_item_hidden_cb,
-                    item_view);
+  if (!g_str_equal (sw_poll_item_view_get_query (view), "own") ||
+      sw_poll_item_view_get_n_pages (view) > 1)
+    return FALSE;
 
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "user-changed",
-                    (GCallback)_service_user_changed_cb,
-                    item_view);
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+  set = sw_service_sina_get_own_timeline (SW_SERVICE_SINA (service),
+                                          sw_poll_item_view_get_page_size (view));
+  if (set == NULL)
+    return FALSE;
 
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "capabilities-changed",
-                    (GCallback)_service_capabilities_changed_cb,
-                    item_view);
+  sw_item_view_set_from_set (SW_ITEM_VIEW (view), set);
+  sw_set_unref (set);
 
-  if (G_OBJECT_CLASS (sw_sina_item_view_parent_class)->constructed)
-    G_OBJECT_CLASS (sw_sina_item_view_parent_class)->constructed (object);
+  return TRUE;
 }
 
 static void
 sw_sina_item_view_class_init (SwSinaItemViewClass *klass)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  SwItemViewClass *item_view_class = SW_ITEM_VIEW_CLASS (klass);
-  GParamSpec *pspec;
-
-  g_type_class_add_private (klass, sizeof (SwSinaItemViewPrivate));
-
-  object_class->get_property = sw_sina_item_view_get_property;
-  object_class->set_property = sw_sina_item_view_set_property;
-  object_class->dispose = sw_sina_item_view_dispose;
-  object_class->finalize = sw_sina_item_view_finalize;
-  object_class->constructed = sw_sina_item_view_constructed;
-
-  item_view_class->start = sina_item_view_start;
-  item_view_class->stop = sina_item_view_stop;
-  item_view_class->refresh = sina_item_view_refresh;
-
-  pspec = g_param_spec_object ("proxy",
-                               "proxy",
-                               "proxy",
-                               REST_TYPE_PROXY,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PROXY, pspec);
-
-  pspec = g_param_spec_string ("query",
-                               "query",
-                               "query",
-                               NULL,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_QUERY, pspec);
-
-  pspec = g_param_spec_boxed ("params",
-                              "params",
-                              "params",
-                              G_TYPE_HASH_TABLE,
-                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PARAMS, pspec);
+  SwPollItemViewClass *poll_class = SW_POLL_ITEM_VIEW_CLASS (klass);
+
+  poll_class->info = &sina_info;
+  poll_class->get_endpoint = sina_item_view_get_endpoint;
+  poll_class->parse_page = sina_item_view_parse_page;
+  poll_class->fetch_local = sina_item_view_fetch_local;
 }
 
 static void
 sw_sina_item_view_init (SwSinaItemView *self)
 {
-  /* Initialize private variables */
 }
@@ -50,6 +50,10 @@
 
 #include "sina.h"
 #include "sina-item-view.h"
+#include "outbox.h"
+#include "http-session.h"
+#include "circuit-breaker.h"
+#include "rate-governor.h"
 
 static void initable_iface_init (gpointer g_iface, gpointer iface_data);
 static void query_iface_init (gpointer g_iface, gpointer iface_data);
@@ -71,32 +75,43 @@ G_DEFINE_TYPE_WITH_CODE (SwServiceSina,
 #define GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_SERVICE_SINA, SwServiceSinaPrivate))
 
+/* Default API quota per user, corrected by the rate-limit headers */
+#define SINA_HOURLY_LIMIT 150
+
+/*
+ * How long the own timeline is served without asking again: the five minute
+ * poll period plus some slack, so a store the feed fills on every poll keeps
+ * the own view off the network for as long as the feed is polling.  Statuses
+ * posted here clear it; one posted elsewhere shows up a poll later at most.
+ */
+#define SINA_OWN_MAX_AGE (5 * 60 + 60)
+
 struct _SwServiceSinaPrivate {
   gboolean inited;
+  guint init_id;
+  gboolean activated;
   RestProxy *proxy;
   char *user_id;
   char *image_url;
+  gboolean configured;
+  RestProxy *configured_proxy;
+  Outbox *outbox;
+  /*
+   * The first page of the user's own timeline, from whichever view fetched
+   * it last, with the count it was asked for and when
+   */
+  SwSet *own;
+  guint own_count;
+  time_t own_time;
 };
 
 static void online_notify (gboolean online, gpointer user_data);
 static void credentials_updated (SwService *service);
-
-static gboolean
-account_is_configured ()
-{ 
-  RestProxy *proxy;
-  gboolean configured = FALSE;
-  const char *key = NULL, *secret = NULL;
-
-  sw_keystore_get_key_secret ("sina", &key, &secret);
-  proxy = oauth_proxy_new (key, secret, "http://api.t.sina.com.cn/", FALSE);
-  
-  configured = sw_keyfob_oauth_sync ((OAuthProxy *)proxy);
-  
-  g_object_unref (proxy);
- 
-  return configured;
-}
+static RestProxyCall *make_status_call (const char *msg, gpointer user_data);
+static OutboxResult status_sent_cb (const char    *msg,
+                                    RestProxyCall *call,
+                                    const GError  *error,
+                                    gpointer       user_data);
 
 static const char **
 get_static_caps (SwService *service)
@@ -121,7 +136,6 @@ static const char **
 get_dynamic_caps (SwService *service)
 {
   SwServiceSinaPrivate *priv = SW_SERVICE_SINA (service)->priv;
-  gboolean configured = FALSE;
   static const char *no_caps[] = { NULL };
   static const char *configured_caps[] = {
     IS_CONFIGURED,
@@ -136,16 +150,50 @@ get_dynamic_caps (SwService *service)
   };
 
   if (priv->user_id)
-    return full_caps;
-
-  configured = account_is_configured ();
+    return circuit_breaker_get_caps (priv->proxy, full_caps);
 
-  if (configured)
+  if (priv->configured)
     return configured_caps;
   else
     return no_caps;
 }
 
+/*
+ * Looking the tokens up in the keyring is slow, so whether the account is
+ * configured is checked once in the background and cached until the
+ * credentials are updated.
+ */
+static void
+check_configured_cb (RestProxy *proxy, gboolean authorised, gpointer user_data)
+{
+  SwService *service = SW_SERVICE (user_data);
+  SwServiceSinaPrivate *priv = GET_PRIVATE (service);
+
+  /* Ignore the answer if the credentials changed in the meantime */
+  if (proxy == priv->configured_proxy) {
+    priv->configured_proxy = NULL;
+    priv->configured = authorised;
+    sw_service_emit_capabilities_changed (service, get_dynamic_caps (service));
+  }
+
+  g_object_unref (proxy);
+  g_object_unref (service);
+}
+
+static void
+check_configured (SwServiceSina *sina)
+{
+  SwServiceSinaPrivate *priv = GET_PRIVATE (sina);
+  const char *key = NULL, *secret = NULL;
+
+  sw_keystore_get_key_secret ("sina", &key, &secret);
+  priv->configured_proxy = oauth_proxy_new (key, secret, "http://api.t.sina.com.cn/", FALSE);
+
+  sw_keyfob_oauth ((OAuthProxy *)priv->configured_proxy,
+                   check_configured_cb,
+                   g_object_ref (sina));
+}
+
 static void got_tokens_cb (RestProxy *proxy, gboolean authorised, gpointer user_data);
 
 static void
@@ -184,7 +232,7 @@ got_tokens_cb (RestProxy *proxy, gboolean authorised, gpointer user_data)
   SwServiceSinaPrivate *priv = GET_PRIVATE (sina);
   RestProxyCall *call;
 
-  if (authorised) {
+  if (authorised && priv->activated) {
     call = rest_proxy_new_call (priv->proxy);
     rest_proxy_call_set_function (call, "account/verify_credentials.xml");
     rest_proxy_call_async (call, got_user_cb, (GObject*)sina, NULL, NULL);
@@ -214,13 +262,31 @@ online_notify (gboolean online, gpointer user_data)
 static void
 refresh_credentials (SwServiceSina *sina)
 {
+  check_configured (sina);
+
   online_notify (FALSE, (SwService *)sina);
   online_notify (TRUE, (SwService *)sina);
 }
 
+static void
+clear_own_timeline (SwServiceSina *sina)
+{
+  SwServiceSinaPrivate *priv = GET_PRIVATE (sina);
+
+  if (priv->own) {
+    sw_set_unref (priv->own);
+    priv->own = NULL;
+  }
+}
+
 static void
 credentials_updated (SwService *service)
 {
+  /* The user just changed the account, so verify it straight away */
+  GET_PRIVATE (service)->activated = TRUE;
+
+  clear_own_timeline (SW_SERVICE_SINA (service));
+
   refresh_credentials (SW_SERVICE_SINA (service));
 
   sw_service_emit_user_changed (service);
@@ -240,6 +306,18 @@ sw_service_sina_dispose (GObject *object)
 
   sw_online_remove_notify (online_notify, object);
 
+  if (priv->init_id) {
+    g_source_remove (priv->init_id);
+    priv->init_id = 0;
+  }
+
+  if (priv->outbox) {
+    outbox_free (priv->outbox);
+    priv->outbox = NULL;
+  }
+
+  clear_own_timeline (SW_SERVICE_SINA (object));
+
   /* unref private variables */
   if (priv->proxy) {
     g_object_unref (priv->proxy);
@@ -284,6 +362,98 @@ sw_service_sina_init (SwServiceSina *self)
   self->priv->inited = FALSE;
 }
 
+/*
+ * The keyring lookups are deferred to an idle so that the daemon can load
+ * every module first and the lookups of all services run concurrently.
+ */
+static gboolean
+deferred_init_cb (gpointer user_data)
+{
+  SwServiceSina *sina = SW_SERVICE_SINA (user_data);
+
+  sina->priv->init_id = 0;
+  refresh_credentials (sina);
+
+  return FALSE;
+}
+
+/*
+ * Logging in waits until a client actually needs the service, so a cold
+ * start doesn't pay for logins nobody asked for.
+ */
+static void
+activate (SwServiceSina *sina)
+{
+  SwServiceSinaPrivate *priv = GET_PRIVATE (sina);
+
+  if (priv->activated)
+    return;
+
+  priv->activated = TRUE;
+
+  if (sw_is_online () && priv->user_id == NULL)
+    online_notify (TRUE, sina);
+}
+
+static void
+_capabilities_changed_cb (SwService    *service,
+                          const gchar **caps,
+                          gpointer      user_data)
+{
+  SwServiceSinaPrivate *priv = GET_PRIVATE (service);
+
+  outbox_set_ready (priv->outbox,
+                    sw_service_has_cap (caps, CREDENTIALS_VALID));
+}
+
+/*
+ * The feed fetches the first page of the user's own timeline along with the
+ * friends' one, which is all an "own" view usually shows.  The feed records
+ * what it got here and a periodic poll of the own view is served from it
+ * while it's fresh, rather than asking Sina for the same page again.
+ */
+void
+sw_service_sina_set_own_timeline (SwServiceSina *sina,
+                                  SwSet         *set,
+                                  guint          count)
+{
+  SwServiceSinaPrivate *priv = GET_PRIVATE (sina);
+
+  clear_own_timeline (sina);
+
+  priv->own = sw_set_ref (set);
+  priv->own_count = count;
+  priv->own_time = time (NULL);
+}
+
+static gboolean
+_own_item_visible (SwSet   *set,
+                   GObject *object,
+                   gpointer user_data)
+{
+  SwItem *item = SW_ITEM (object);
+
+  return !sw_service_is_uid_banned (SW_SERVICE (user_data),
+                                    sw_item_get (item, "id"));
+}
+
+/*
+ * The own timeline with at least @count statuses, less any hidden since, or
+ * NULL if there's none that fresh
+ */
+SwSet *
+sw_service_sina_get_own_timeline (SwServiceSina *sina,
+                                  guint          count)
+{
+  SwServiceSinaPrivate *priv = GET_PRIVATE (sina);
+
+  if (priv->own == NULL || priv->own_count < count ||
+      time (NULL) - priv->own_time >= SINA_OWN_MAX_AGE)
+    return NULL;
+
+  return sw_set_filter (priv->own, _own_item_visible, sina);
+}
+
 /* Initable interface */
 
 static gboolean
@@ -309,10 +479,22 @@ sw_service_sina_initable (GInitable    *initable,
     return FALSE;
   }
   priv->proxy = oauth_proxy_new (key, secret, "http://api.t.sina.com.cn/", FALSE);
+  http_session_setup (priv->proxy, "sina");
+  circuit_breaker_attach (priv->proxy, SW_SERVICE (sina));
+  rate_governor_attach (priv->proxy, SINA_HOURLY_LIMIT);
+
+  priv->outbox = outbox_new ("sina", G_OBJECT (sina),
+                             make_status_call, status_sent_cb, sina);
+  g_signal_connect (sina, "capabilities-changed",
+                    G_CALLBACK (_capabilities_changed_cb), NULL);
+
+  /* Updates left over from the last run need a login to go out */
+  if (!outbox_is_empty (priv->outbox))
+    priv->activated = TRUE;
 
   sw_online_add_notify (online_notify, sina);
 
-  refresh_credentials (sina);
+  priv->init_id = g_idle_add (deferred_init_cb, sina);
 
   priv->inited = TRUE;
 
@@ -366,6 +548,8 @@ _sina_query_open_view (SwQueryIface          *self,
     return;
   }
 
+  activate (SW_SERVICE_SINA (self));
+
   item_view = g_object_new (SW_TYPE_SINA_ITEM_VIEW,
                             "proxy", priv->proxy,
                             "service", self,
@@ -409,6 +593,8 @@ _sina_avatar_request_avatar (SwAvatarIface         *self,
 {
   SwServiceSinaPrivate *priv = GET_PRIVATE (self);
 
+  activate (SW_SERVICE_SINA (self));
+
   if (priv->image_url) {
     sw_web_download_image_async (priv->image_url,
                                  _requested_avatar_downloaded_cb,
@@ -429,21 +615,66 @@ avatar_iface_init (gpointer g_iface,
 }
 
 /* Status Update interface */
-static void
-_update_status_cb (RestProxyCall *call,
-                   const GError  *error,
-                   GObject       *weak_object,
-                   gpointer       userdata)
+static RestProxyCall *
+make_status_call (const char *msg,
+                  gpointer    user_data)
 {
-  if (error)
-  {
+  SwServiceSinaPrivate *priv = GET_PRIVATE (user_data);
+  RestProxyCall *call;
+
+  if (!priv->user_id ||
+      !rate_governor_acquire (priv->proxy, RATE_PRIORITY_REQUEST, 1))
+    return NULL;
+
+  call = rest_proxy_new_call (priv->proxy);
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_set_function (call, "statuses/update.xml");
+
+  rest_proxy_call_add_params (call,
+                              "status", msg,
+                              NULL);
+
+  return call;
+}
+
+static OutboxResult
+status_sent_cb (const char    *msg,
+                RestProxyCall *call,
+                const GError  *error,
+                gpointer       user_data)
+{
+  OutboxResult result;
+
+  rate_governor_update (GET_PRIVATE (user_data)->proxy, call);
+
+  result = outbox_classify (call, error);
+
+  switch (result) {
+  case OUTBOX_SENT:
+    SW_DEBUG (TWITTER, G_STRLOC ": Status updated.");
+    /* The own timeline has a new status now */
+    clear_own_timeline (SW_SERVICE_SINA (user_data));
+    sw_status_update_iface_emit_status_updated (user_data, TRUE);
+    break;
+  case OUTBOX_RETRY:
+    g_message ("Error updating status, will retry: %s", error->message);
+    break;
+  case OUTBOX_DROP:
     g_critical (G_STRLOC ": Error updating status: %s",
                 error->message);
-    sw_status_update_iface_emit_status_updated (weak_object, FALSE);
-  } else {
-    SW_DEBUG (TWITTER, G_STRLOC ": Status updated.");
-    sw_status_update_iface_emit_status_updated (weak_object, TRUE);
+    sw_status_update_iface_emit_status_updated (user_data, FALSE);
+    break;
+  case OUTBOX_UNKNOWN:
+    g_message ("Status update may not have been posted: %s", error->message);
+    sw_status_update_iface_emit_status_updated (user_data, FALSE);
+    break;
+  case OUTBOX_HOLD:
+    g_message ("Status update held until the login is renewed: %s",
+               error->message);
+    break;
   }
+
+  return result;
 }
 
 static void
@@ -454,20 +685,11 @@ _sina_status_update_update_status (SwStatusUpdateIface   *self,
 {
   SwServiceSina *sina = SW_SERVICE_SINA (self);
   SwServiceSinaPrivate *priv = GET_PRIVATE (sina);
-  RestProxyCall *call;
-
-  if (!priv->user_id)
-    return;
-
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_method (call, "POST");
-  rest_proxy_call_set_function (call, "statuses/update.xml");
 
-  rest_proxy_call_add_params (call,
-                              "status", msg,
-                              NULL);
+  activate (sina);
 
-  rest_proxy_call_async (call, _update_status_cb, (GObject *)self, NULL, NULL);
+  /* Queued so that nothing is lost while offline or authorising */
+  outbox_push (priv->outbox, msg);
   sw_status_update_iface_return_from_update_status (context);
 }
 
@@ -23,6 +23,7 @@
 #define _SW_SERVICE_SINA
 
 #include <libsocialweb/sw-service.h>
+#include <libsocialweb/sw-set.h>
 
 G_BEGIN_DECLS
 
@@ -56,6 +57,12 @@ typedef struct {
 
 GType sw_service_sina_get_type (void);
 
+void   sw_service_sina_set_own_timeline (SwServiceSina *sina,
+                                         SwSet         *set,
+                                         guint          count);
+SwSet *sw_service_sina_get_own_timeline (SwServiceSina *sina,
+                                         guint          count);
+
 G_END_DECLS
 
 #endif /* _SW_SERVICE_SINA */
@@ -28,19 +28,20 @@
 #include <rest/rest-proxy.h>
 #include <rest/rest-xml-parser.h>
 #include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
 
 #include <libsocialweb/sw-debug.h>
 #include <libsocialweb/sw-item.h>
-#include <libsocialweb/sw-cache.h>
 
 #include <glib/gi18n.h>
 
 #include "utils.h"
+#include "rate-governor.h"
 
 #include "youtube-item-view.h"
 #include "youtube.h"
 
-G_DEFINE_TYPE (SwYoutubeItemView, sw_youtube_item_view, SW_TYPE_ITEM_VIEW)
+G_DEFINE_TYPE (SwYoutubeItemView, sw_youtube_item_view, SW_TYPE_POLL_ITEM_VIEW)
 
 #define GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_YOUTUBE_ITEM_VIEW, SwYoutubeItemViewPrivate))
@@ -48,35 +49,46 @@ G_DEFINE_TYPE (SwYoutubeItemView, sw_youtube_item_view, SW_TYPE_ITEM_VIEW)
 typedef struct _SwYoutubeItemViewPrivate SwYoutubeItemViewPrivate;
 
 struct _SwYoutubeItemViewPrivate {
-  guint timeout_id;
-  GHashTable *params;
-  gchar *query;
-  RestProxy *proxy;
   gchar *developer_key;
-
-  SwSet *set;
+  /* Author name to avatar url, for the authors looked up so far */
   GHashTable *thumb_map;
+  /* Author name to the items held pending until their avatar is known */
+  GHashTable *waiting;
+  /* The author names of each batch lookup in flight */
+  GList *batches;
 };
 
 enum
 {
   PROP_0,
-  PROP_PROXY,
-  PROP_PARAMS,
-  PROP_QUERY,
   PROP_DEVKEY
 };
 
-#define UPDATE_TIMEOUT 5 * 60
-
-static void _service_item_hidden_cb (SwService   *service,
-                                     const gchar *uid,
-                                     SwItemView  *item_view);
-static void _service_user_changed_cb (SwService  *service,
-                                      SwItemView *item_view);
-static void _service_capabilities_changed_cb (SwService    *service,
-                                              const gchar **caps,
-                                              SwItemView   *item_view);
+#define USERS_BATCH "users/batch"
+#define VIDEO_TAG "tag:youtube.com,2008:video:"
+#define VIDEO_URL "http://gdata.youtube.com/feeds/api/videos/"
+
+/* Only what make_item reads, rather than the whole entry */
+#define FEED_FIELDS "entry(id,updated,title,author(name)," \
+  "link[@rel='alternate'](@href)," \
+  "media:group(media:thumbnail[@yt:name='default'](@url)))"
+#define USERS_URL "http://gdata.youtube.com/feeds/api/users/"
+
+/* The most entries GData takes in one batch */
+#define BATCH_MAX 50
+
+static const PollItemViewInfo youtube_info = {
+  .name = "youtube",
+  .endpoint = NULL,
+  .default_page_size = 10,
+  /* The most GData hands out in one go */
+  .max_page_size = 50,
+  .max_pages = 10,
+  .count_param = "max-results",
+  .page_param = "start-index",
+  .paging = POLL_PAGING_INDEX,
+  .first_page = 1
+};
 
 static void
 sw_youtube_item_view_get_property (GObject    *object,
@@ -87,15 +99,6 @@ sw_youtube_item_view_get_property (GObject    *object,
   SwYoutubeItemViewPrivate *priv = GET_PRIVATE (object);
 
   switch (property_id) {
-    case PROP_PROXY:
-      g_value_set_object (value, priv->proxy);
-      break;
-    case PROP_PARAMS:
-      g_value_set_boxed (value, priv->params);
-      break;
-    case PROP_QUERY:
-      g_value_set_string (value, priv->query);
-      break;
     case PROP_DEVKEY:
       g_value_set_string (value, priv->developer_key);
       break;
@@ -113,20 +116,8 @@ sw_youtube_item_view_set_property (GObject      *object,
   SwYoutubeItemViewPrivate *priv = GET_PRIVATE (object);
 
   switch (property_id) {
-    case PROP_PROXY:
-      if (priv->proxy)
-      {
-        g_object_unref (priv->proxy);
-      }
-      priv->proxy = g_value_dup_object (value);
-      break;
-    case PROP_PARAMS:
-      priv->params = g_value_dup_boxed (value);
-      break;
-    case PROP_QUERY:
-      priv->query = g_value_dup_string (value);
-      break;
     case PROP_DEVKEY:
+      g_free (priv->developer_key);
       priv->developer_key = g_value_dup_string (value);
       break;
   default:
@@ -134,82 +125,209 @@ sw_youtube_item_view_set_property (GObject      *object,
   }
 }
 
+static void release_items (GList *items, const char *url);
+
+static void
+_release_waiting_cb (const char *author,
+                     GList      *items,
+                     gpointer    userdata)
+{
+  release_items (items, NULL);
+}
+
 static void
-sw_youtube_item_view_dispose (GObject *object)
+sw_youtube_item_view_finalize (GObject *object)
 {
-  SwItemView *item_view = SW_ITEM_VIEW (object);
   SwYoutubeItemViewPrivate *priv = GET_PRIVATE (object);
+  GList *l;
 
-  if (priv->proxy)
-  {
-    g_object_unref (priv->proxy);
-    priv->proxy = NULL;
-  }
+  g_free (priv->developer_key);
+  g_hash_table_unref (priv->thumb_map);
+  g_hash_table_foreach (priv->waiting, (GHFunc)_release_waiting_cb, NULL);
+  g_hash_table_unref (priv->waiting);
+
+  for (l = priv->batches; l; l = l->next)
+    g_ptr_array_free (l->data, TRUE);
+  g_list_free (priv->batches);
+
+  G_OBJECT_CLASS (sw_youtube_item_view_parent_class)->finalize (object);
+}
+
+static gboolean
+add_auth_headers (SwYoutubeItemView *youtube, RestProxyCall *call)
+{
+  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (youtube);
+  SwService *service = sw_item_view_get_service ((SwItemView *)youtube);
+  char *user_auth_header = NULL, *devkey_header = NULL;
+  const char *user_auth = NULL;
+
+  user_auth = sw_service_youtube_get_user_auth (SW_SERVICE_YOUTUBE (service));
+  if (user_auth == NULL)
+    return FALSE;
+
+  user_auth_header = g_strdup_printf ("GoogleLogin auth=%s", user_auth);
+  rest_proxy_call_add_header (call, "Authorization", user_auth_header);
+  devkey_header = g_strdup_printf ("key=%s", priv->developer_key);
+  rest_proxy_call_add_header (call, "X-GData-Key", devkey_header);
+
+  g_free (user_auth_header);
+  g_free (devkey_header);
+
+  return TRUE;
+}
+
+/* Give the items waiting on an author their avatar, if one was found */
+static void
+release_items (GList *items, const char *url)
+{
+  GList *l;
+
+  for (l = items; l; l = l->next) {
+    SwItem *item = l->data;
 
-  if (priv->timeout_id)
-  {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
+    if (url)
+      sw_item_request_image_fetch (item, FALSE, "authoricon", url);
+    sw_item_pop_pending (item);
+    g_object_unref (item);
   }
 
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                      _service_item_hidden_cb,
-                                      item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_user_changed_cb,
-                                        item_view);
-  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
-                                        _service_capabilities_changed_cb,
-                                        item_view);
-
-  G_OBJECT_CLASS (sw_youtube_item_view_parent_class)->dispose (object);
+  g_list_free (items);
 }
 
 static void
-sw_youtube_item_view_finalize (GObject *object)
+release_author (SwYoutubeItemView *youtube, const char *author)
 {
-  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (object);
+  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (youtube);
+  gpointer key, items;
 
-  g_free (priv->query);
-  g_hash_table_unref (priv->params);
-  g_hash_table_unref (priv->thumb_map);
+  if (!g_hash_table_lookup_extended (priv->waiting, author, &key, &items))
+    return;
 
-  G_OBJECT_CLASS (sw_youtube_item_view_parent_class)->finalize (object);
+  g_hash_table_steal (priv->waiting, author);
+  release_items (items, g_hash_table_lookup (priv->thumb_map, author));
+  g_free (key);
 }
 
-static char *
-get_author_icon_url (SwYoutubeItemView *youtube, const char *author)
+static void
+_got_authors_cb (RestProxyCall *call,
+                 const GError  *error,
+                 GObject       *weak_object,
+                 gpointer       userdata)
 {
+  SwYoutubeItemView *youtube = SW_YOUTUBE_ITEM_VIEW (weak_object);
   SwYoutubeItemViewPrivate *priv = GET_PRIVATE (youtube);
-  RestProxyCall *call;
-  RestXmlNode *root, *node;
-  char *function, *url;
+  GPtrArray *authors = userdata;
+  RestXmlNode *root = NULL, *entry, *id, *thumb;
+  const char *url;
+  guint i;
 
-  url = g_hash_table_lookup (priv->thumb_map, author);
-  if (url)
-    return g_strdup (url);
+  priv->batches = g_list_remove (priv->batches, authors);
 
-  call = rest_proxy_new_call (priv->proxy);
-  function = g_strdup_printf ("users/%s", author);
-  rest_proxy_call_set_function (call, function);
-  rest_proxy_call_sync (call, NULL);
+  if (error)
+    g_message ("Error: %s", error->message);
+  else
+    root = xml_node_from_call (call, "Youtube");
 
-  root = xml_node_from_call (call, "Youtube");
-  if (!root)
-    return NULL;
+  /*
+   * Each entry of the answer is the profile asked for under its batch:id,
+   * or just a failed batch:status if there was none.
+   */
+  if (root) {
+    for (entry = rest_xml_node_find (root, "entry"); entry; entry = entry->next) {
+      id = rest_xml_node_find (entry, "batch:id");
+      thumb = rest_xml_node_find (entry, "media:thumbnail");
+      if (!id || !id->content || !thumb)
+        continue;
+
+      url = rest_xml_node_get_attr (thumb, "url");
+      if (url)
+        g_hash_table_insert (priv->thumb_map,
+                             g_strdup (id->content), g_strdup (url));
+    }
+    rest_xml_node_unref (root);
+  }
 
-  node = rest_xml_node_find (root, "media:thumbnail");
-  if (!node)
-    return NULL;
+  for (i = 0; i < authors->len; i++)
+    release_author (youtube, g_ptr_array_index (authors, i));
+
+  g_ptr_array_free (authors, TRUE);
+  g_object_unref (call);
+}
+
+/*
+ * Look the profiles of @authors up in one GData batch query rather than a
+ * users/<author> call each.  Takes @authors.
+ */
+static void
+request_authors (SwYoutubeItemView *youtube, GPtrArray *authors)
+{
+  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (youtube);
+  RestProxy *proxy = sw_poll_item_view_get_proxy ((SwPollItemView *)youtube);
+  RestProxyCall *call;
+  GString *body;
+  char *author;
+  guint i;
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_set_function (call, USERS_BATCH);
+  rest_proxy_call_add_header (call, "Content-Type", "application/atom+xml");
+
+  body = g_string_new ("<feed xmlns='http://www.w3.org/2005/Atom' "
+                       "xmlns:batch='http://schemas.google.com/gdata/batch'>"
+                       "<batch:operation type='query'/>");
+  for (i = 0; i < authors->len; i++) {
+    author = g_markup_escape_text (g_ptr_array_index (authors, i), -1);
+    g_string_append_printf (body,
+                            "<entry><id>" USERS_URL "%s</id>"
+                            "<batch:id>%s</batch:id></entry>",
+                            author, author);
+    g_free (author);
+  }
+  g_string_append (body, "</feed>");
+  rest_proxy_call_set_body (call, g_string_free (body, FALSE));
+
+  if (!add_auth_headers (youtube, call) ||
+      !rate_governor_acquire (proxy, RATE_PRIORITY_POLL, 1) ||
+      !rest_proxy_call_async (call, _got_authors_cb, (GObject *)youtube,
+                              authors, NULL)) {
+    /* Go without avatars rather than hold the items back */
+    for (i = 0; i < authors->len; i++)
+      release_author (youtube, g_ptr_array_index (authors, i));
+    g_ptr_array_free (authors, TRUE);
+    g_object_unref (call);
+    return;
+  }
+
+  priv->batches = g_list_prepend (priv->batches, authors);
+}
+
+/*
+ * Hold @item back until the avatar of @author is known.  Returns TRUE if
+ * @author wasn't already being looked up.
+ */
+static gboolean
+wait_for_author (SwYoutubeItemView *youtube,
+                 SwItem            *item,
+                 const char        *author)
+{
+  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (youtube);
+  GList *items;
+  gboolean first;
 
-  url = g_strdup (rest_xml_node_get_attr (node, "url"));
+  items = g_hash_table_lookup (priv->waiting, author);
+  first = (items == NULL);
 
-  g_free (function);
+  sw_item_push_pending (item);
 
-  if (url)
-    g_hash_table_insert(priv->thumb_map, (gpointer)author, (gpointer)g_strdup (url));
+  /* Appending keeps the head, and so the table entry, the same */
+  if (first)
+    g_hash_table_insert (priv->waiting, g_strdup (author),
+                         g_list_prepend (NULL, g_object_ref (item)));
+  else
+    items = g_list_append (items, g_object_ref (item));
 
-  return url;
+  return first;
 }
 
 static char *
@@ -225,338 +343,278 @@ get_utc_date (const char *s)
   return sw_time_t_to_string (mktime (&tm));
 }
 
-static SwItem *
-make_item (SwYoutubeItemView *item_view,
-           SwService        *service,
-           RestXmlNode      *node)
+/* The text of a GData JSON element, which is kept under "$t" */
+static const char *
+get_text (JsonObject *object, const char *member)
 {
-  SwItem *item;
-  char *author, *date, *url;
-  RestXmlNode *subnode, *thumb_node;
+  JsonNode *node;
 
-  item = sw_item_new ();
-  sw_item_set_service (item, service);
-  /*
-  <rss>
-    <channel>
-      <item>
-        <guid isPermaLink="false">http://gdata.youtube.com/feeds/api/videos/<videoid></guid>
-        <atom:updated>2010-02-13T06:17:32.000Z</atom:updated>
-        <title>Video Title</title>
-        <author>Author Name</author>
-        <link>http://www.youtube.com/watch?v=<videoid>&amp;feature=youtube_gdata</link>
-        <media:group>
-          <media:thumbnail url="http://i.ytimg.com/vi/<videoid>/default.jpg" height="90" width="120" time="00:03:00.500"/>
-        </media:group>
-      </item>
-    </channel>
-  </rss>
-  */
+  node = json_object_get_member (object, member);
+  if (!node || !JSON_NODE_HOLDS_OBJECT (node))
+    return NULL;
 
-  sw_item_put (item, "id", xml_get_child_node_value (node, "guid"));
+  object = json_node_get_object (node);
+  if (!json_object_has_member (object, "$t"))
+    return NULL;
 
-  date = xml_get_child_node_value (node, "atom:updated");
-  if (date != NULL)
-    sw_item_put (item, "date", get_utc_date(date));
+  return json_object_get_string_member (object, "$t");
+}
 
-  sw_item_put (item, "title", xml_get_child_node_value (node, "title"));
-  sw_item_put (item, "url", xml_get_child_node_value (node, "link"));
-  author = xml_get_child_node_value (node, "author");
-  sw_item_put (item, "author", author);
+/* The first object of the array @member, where GData puts repeated elements */
+static JsonObject *
+get_first (JsonObject *object, const char *member)
+{
+  JsonNode *node;
+  JsonArray *array;
 
-  /* media:group */
-  subnode = rest_xml_node_find (node, "media:group");
-  if (subnode){
-    thumb_node = rest_xml_node_find (subnode, "media:thumbnail");
-    url = (char *) rest_xml_node_get_attr (thumb_node, "url");
-    sw_item_request_image_fetch (item, TRUE, "thumbnail", url);
-  }
+  node = json_object_get_member (object, member);
+  if (!node || !JSON_NODE_HOLDS_ARRAY (node))
+    return NULL;
 
-  url = get_author_icon_url (item_view, author);
-  sw_item_request_image_fetch (item, FALSE, "authoricon", url);
-  g_free (url);
+  array = json_node_get_array (node);
+  if (json_array_get_length (array) == 0)
+    return NULL;
 
-  return item;
+  node = json_array_get_element (array, 0);
+  return JSON_NODE_HOLDS_OBJECT (node) ? json_node_get_object (node) : NULL;
 }
 
-static void
-_got_videos_cb (RestProxyCall *call,
-                const GError  *error,
-                GObject       *weak_object,
-                gpointer       user_data)
+/*
+ * Version 2 ids are tag:youtube.com,2008:video:<videoid>, but items have
+ * always been keyed by the version 1 video URL, which is what hidden items
+ * and the cache know them by.
+ */
+static char *
+make_id (const char *id)
 {
-  SwYoutubeItemView *item_view = SW_YOUTUBE_ITEM_VIEW (weak_object);
-  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwService *service;
-  RestXmlNode *root, *node;
-
-  if (error) {
-    g_message (G_STRLOC ": error from Youtube: %s", error->message);
-    /* TODO: cleanup or something */
-    return;
-  }
+  const char *videoid;
 
-  root = xml_node_from_call (call, "Youtube");
-  if (!root)
-    return;
+  if (!g_str_has_prefix (id, VIDEO_TAG))
+    return g_strdup (id);
 
-  node = rest_xml_node_find (root, "channel");
-  if (!node)
-    return;
+  videoid = id + strlen (VIDEO_TAG);
+  return g_strconcat (VIDEO_URL, videoid, NULL);
+}
 
-  /* Clean up the thumbnail mapping cache */
-  g_hash_table_remove_all (priv->thumb_map);
+static SwItem *
+make_item (SwService  *service,
+           JsonObject *entry,
+           const char *id)
+{
+  SwItem *item;
+  JsonObject *object;
+  JsonNode *node;
+  const char *text;
 
-  service = sw_item_view_get_service (SW_ITEM_VIEW (item_view));
+  item = sw_item_new ();
+  sw_item_set_service (item, service);
+  /*
+  {"entry": [{
+    "id": {"$t": "tag:youtube.com,2008:video:<videoid>"},
+    "updated": {"$t": "2010-02-13T06:17:32.000Z"},
+    "title": {"$t": "Video Title"},
+    "author": [{"name": {"$t": "Author Name"}}],
+    "link": [{"href": "http://www.youtube.com/watch?v=<videoid>&feature=youtube_gdata"}],
+    "media$group": {
+      "media$thumbnail": [{"url": "http://i.ytimg.com/vi/<videoid>/default.jpg"}]
+    }
+  }]}
+  */
 
-  for (node = rest_xml_node_find (node, "item"); node; node = node->next) {
-    SwItem *item;
-    item = make_item (item_view, service, node);
+  sw_item_put (item, "id", id);
 
-    if (!sw_service_is_uid_banned (service, sw_item_get (item, "id"))) {
-      sw_set_add (priv->set, (GObject *)item);
-    }
+  text = get_text (entry, "updated");
+  if (text != NULL)
+    sw_item_take (item, "date", get_utc_date (text));
 
-    g_object_unref (item);
-  }
+  sw_item_put (item, "title", get_text (entry, "title"));
 
-  sw_item_view_set_from_set ((SwItemView *)item_view, priv->set);
+  object = get_first (entry, "link");
+  if (object && json_object_has_member (object, "href"))
+    sw_item_put (item, "url", json_object_get_string_member (object, "href"));
 
-  /* Save the results of this set to the cache */
-  sw_cache_save (service,
-                 priv->query,
-                 priv->params,
-                 priv->set);
+  object = get_first (entry, "author");
+  if (object)
+    sw_item_put (item, "author", get_text (object, "name"));
 
-  sw_set_empty (priv->set);
+  /* media:group */
+  node = json_object_get_member (entry, "media$group");
+  if (node && JSON_NODE_HOLDS_OBJECT (node)) {
+    object = get_first (json_node_get_object (node), "media$thumbnail");
+    if (object && json_object_has_member (object, "url"))
+      sw_item_request_image_fetch (item, TRUE, "thumbnail",
+                                   json_object_get_string_member (object, "url"));
+  }
 
-  rest_xml_node_unref (root);
+  return item;
 }
 
-static void
-_get_status_updates (SwYoutubeItemView *item_view)
+static const char *
+youtube_item_view_get_endpoint (SwPollItemView *view,
+                                guint           page,
+                                guint           step)
 {
-  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwService *service = sw_item_view_get_service ((SwItemView *)item_view);
-  RestProxyCall *call;
-  char *user_auth_header = NULL, *devkey_header = NULL;
-  const char *user_auth = NULL;
-
-  user_auth = sw_service_youtube_get_user_auth (SW_SERVICE_YOUTUBE (service));
-  if (user_auth == NULL)
-    return;
-
-  sw_set_empty (priv->set);
+  const char *query = sw_poll_item_view_get_query (view);
 
-  call = rest_proxy_new_call (priv->proxy);
+  if (step > 0)
+    return NULL;
 
-  user_auth_header = g_strdup_printf ("GoogleLogin auth=%s", user_auth);
-  rest_proxy_call_add_header (call, "Authorization", user_auth_header);
-  devkey_header = g_strdup_printf ("key=%s", priv->developer_key);
-  rest_proxy_call_add_header (call, "X-GData-Key", devkey_header);
+  if (g_str_equal (query, "feed"))
+    return "users/default/newsubscriptionvideos";
+  else if (g_str_equal (query, "own"))
+    return "users/default/uploads";
 
-  if (g_str_equal (priv->query, "feed"))
-    rest_proxy_call_set_function (call, "users/default/newsubscriptionvideos");
-  else if (g_str_equal (priv->query, "own"))
-    rest_proxy_call_set_function (call, "users/default/uploads");
-  else
-    g_assert_not_reached ();
-
-  rest_proxy_call_add_params (call,
-                              "max-results", "10",
-                              "alt", "rss",
-                              NULL);
-
-  rest_proxy_call_async (call,
-                         _got_videos_cb,
-                         (GObject *)item_view,
-                         NULL,
-                         NULL);
-  g_free (user_auth_header);
-  g_free (devkey_header);
+  g_assert_not_reached ();
+  return NULL;
 }
 
-
 static gboolean
-_update_timeout_cb (gpointer data)
+youtube_item_view_prepare_call (SwPollItemView *view,
+                                RestProxyCall  *call,
+                                const char     *endpoint)
 {
-  SwYoutubeItemView *item_view = SW_YOUTUBE_ITEM_VIEW (data);
+  if (!add_auth_headers ((SwYoutubeItemView *)view, call))
+    return FALSE;
 
-  _get_status_updates (item_view);
+  /* Partial responses need version 2 of the API */
+  rest_proxy_call_add_header (call, "GData-Version", "2");
+  rest_proxy_call_add_param (call, "alt", "json");
+  rest_proxy_call_add_param (call, "fields", FEED_FIELDS);
 
   return TRUE;
 }
 
-static void
-_load_from_cache (SwYoutubeItemView *item_view)
+static gint
+youtube_item_view_parse_page (SwPollItemView *view,
+                              RestProxyCall  *call,
+                              const char     *endpoint)
 {
-  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (item_view);
-  SwSet *set;
-
-  set = sw_cache_load (sw_item_view_get_service (SW_ITEM_VIEW (item_view)),
-                       priv->query,
-                       priv->params);
-
-  if (set)
-  {
-    sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                               set);
-    sw_set_unref (set);
-  }
-}
+  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (view);
+  SwService *service;
+  JsonNode *root, *node;
+  JsonObject *feed;
+  JsonArray *entries;
+  GPtrArray *authors;
+  guint i, length;
 
-static void
-youtube_item_view_start (SwItemView *item_view)
-{
-  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View already started.");
-  } else {
-    priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                              (GSourceFunc)_update_timeout_cb,
-                                              item_view);
-
-    _load_from_cache ((SwYoutubeItemView *)item_view);
-    _get_status_updates ((SwYoutubeItemView *)item_view);
+  root = json_node_from_call (call, "Youtube");
+  if (!root)
+    return -1;
+  sw_poll_item_view_mark_parsed (view);
+
+  node = JSON_NODE_HOLDS_OBJECT (root) ?
+    json_object_get_member (json_node_get_object (root), "feed") : NULL;
+  if (!node || !JSON_NODE_HOLDS_OBJECT (node)) {
+    json_node_free (root);
+    return -1;
   }
-}
 
-static void
-youtube_item_view_stop (SwItemView *item_view)
-{
-  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (item_view);
-
-  if (!priv->timeout_id)
-  {
-    g_warning (G_STRLOC ": View not running");
-  } else {
-    g_source_remove (priv->timeout_id);
-    priv->timeout_id = 0;
+  /* An empty feed leaves the entries out altogether */
+  feed = json_node_get_object (node);
+  node = json_object_get_member (feed, "entry");
+  if (!node || !JSON_NODE_HOLDS_ARRAY (node)) {
+    json_node_free (root);
+    return 0;
   }
-}
 
-static void
-youtube_item_view_refresh (SwItemView *item_view)
-{
-  _get_status_updates ((SwYoutubeItemView *)item_view);
-}
+  entries = json_node_get_array (node);
+  length = json_array_get_length (entries);
 
-static void
-_service_item_hidden_cb (SwService   *service,
-                         const gchar *uid,
-                         SwItemView  *item_view)
-{
-  sw_item_view_remove_by_uid (item_view, uid);
-}
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+  authors = g_ptr_array_new_with_free_func (g_free);
 
-static void
-_service_user_changed_cb (SwService  *service,
-                          SwItemView *item_view)
-{
-  SwSet *set;
+  for (i = 0; i < length; i++) {
+    JsonNode *entry_node = json_array_get_element (entries, i);
+    JsonObject *entry;
+    SwItem *item;
+    const char *author, *url, *tag;
+    char *id;
+
+    if (!JSON_NODE_HOLDS_OBJECT (entry_node))
+      continue;
 
-  /* We need to empty the set */
-  set = sw_item_set_new ();
-  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
-                             set);
-  sw_set_unref (set);
+    entry = json_node_get_object (entry_node);
+    tag = get_text (entry, "id");
+    if (tag == NULL)
+      continue;
 
-  /* And drop the cache */
-  sw_cache_drop_all (service);
+    id = make_id (tag);
+    if (sw_poll_item_view_is_banned (view, "", id)) {
+      g_free (id);
+      continue;
+    }
+
+    item = make_item (service, entry, id);
+    g_free (id);
+
+    /* The avatars of authors not seen before are looked up together below */
+    author = sw_item_get (item, "author");
+    if (author) {
+      url = g_hash_table_lookup (priv->thumb_map, author);
+      if (url)
+        sw_item_request_image_fetch (item, FALSE, "authoricon", url);
+      else if (wait_for_author ((SwYoutubeItemView *)view, item, author))
+        g_ptr_array_add (authors, g_strdup (author));
+    }
+
+    sw_poll_item_view_add_item (view, item);
+
+    if (authors->len == BATCH_MAX) {
+      request_authors ((SwYoutubeItemView *)view, authors);
+      authors = g_ptr_array_new_with_free_func (g_free);
+    }
+  }
+
+  json_node_free (root);
+
+  if (authors->len > 0)
+    request_authors ((SwYoutubeItemView *)view, authors);
+  else
+    g_ptr_array_free (authors, TRUE);
+
+  return length;
 }
 
 static void
-_service_capabilities_changed_cb (SwService    *service,
-                                  const gchar **caps,
-                                  SwItemView   *item_view)
+youtube_item_view_call_failed (SwPollItemView *view,
+                               RestProxyCall  *call,
+                               const GError   *error)
 {
-  SwYoutubeItemViewPrivate *priv = GET_PRIVATE ((SwYoutubeItemView*) item_view);
-
-  if (sw_service_has_cap (caps, CREDENTIALS_VALID))
-  {
-    youtube_item_view_refresh (item_view);
+  SwService *service;
 
-    if (!priv->timeout_id)
-    {
-      priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
-                                                (GSourceFunc)_update_timeout_cb,
-                                                item_view);
-    }
-  } else {
-    if (priv->timeout_id)
-    {
-      g_source_remove (priv->timeout_id);
-      priv->timeout_id = 0;
-    }
+  if (rest_proxy_call_get_status_code (call) == SOUP_STATUS_UNAUTHORIZED) {
+    service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+    sw_service_youtube_invalidate_session (SW_SERVICE_YOUTUBE (service));
   }
 }
 
 static void
-sw_youtube_item_view_constructed (GObject *object)
+youtube_item_view_user_changed (SwPollItemView *view)
 {
-  SwItemView *item_view = SW_ITEM_VIEW (object);
-
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "item-hidden",
-                    (GCallback)_service_item_hidden_cb,
-                    item_view);
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "user-changed",
-                    (GCallback)_service_user_changed_cb,
-                    item_view);
-  g_signal_connect (sw_item_view_get_service (item_view),
-                    "capabilities-changed",
-                    (GCallback)_service_capabilities_changed_cb,
-                    item_view);
-
-  if (G_OBJECT_CLASS (sw_youtube_item_view_parent_class)->constructed)
-    G_OBJECT_CLASS (sw_youtube_item_view_parent_class)->constructed (object);
+  SwYoutubeItemViewPrivate *priv = GET_PRIVATE (view);
+
+  g_hash_table_remove_all (priv->thumb_map);
 }
 
 static void
 sw_youtube_item_view_class_init (SwYoutubeItemViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  SwItemViewClass *item_view_class = SW_ITEM_VIEW_CLASS (klass);
+  SwPollItemViewClass *poll_class = SW_POLL_ITEM_VIEW_CLASS (klass);
   GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (SwYoutubeItemViewPrivate));
 
   object_class->get_property = sw_youtube_item_view_get_property;
   object_class->set_property = sw_youtube_item_view_set_property;
-  object_class->dispose = sw_youtube_item_view_dispose;
   object_class->finalize = sw_youtube_item_view_finalize;
-  object_class->constructed = sw_youtube_item_view_constructed;
-
-  item_view_class->start = youtube_item_view_start;
-  item_view_class->stop = youtube_item_view_stop;
-  item_view_class->refresh = youtube_item_view_refresh;
-
-  pspec = g_param_spec_object ("proxy",
-                               "proxy",
-                               "proxy",
-                               REST_TYPE_PROXY,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PROXY, pspec);
-
-
-  pspec = g_param_spec_string ("query",
-                               "query",
-                               "query",
-                               NULL,
-                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_QUERY, pspec);
-
-
-  pspec = g_param_spec_boxed ("params",
-                              "params",
-                              "params",
-                              G_TYPE_HASH_TABLE,
-                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
-  g_object_class_install_property (object_class, PROP_PARAMS, pspec);
 
+  poll_class->info = &youtube_info;
+  poll_class->get_endpoint = youtube_item_view_get_endpoint;
+  poll_class->prepare_call = youtube_item_view_prepare_call;
+  poll_class->parse_page = youtube_item_view_parse_page;
+  poll_class->call_failed = youtube_item_view_call_failed;
+  poll_class->user_changed = youtube_item_view_user_changed;
 
   pspec = g_param_spec_string ("developer_key",
                                "developer_key",
@@ -571,6 +629,8 @@ sw_youtube_item_view_init (SwYoutubeItemView *self)
 {
   SwYoutubeItemViewPrivate *priv = GET_PRIVATE (self);
 
-  priv->set = sw_item_set_new ();
-  priv->thumb_map = g_hash_table_new(g_str_hash, g_str_equal);
+  priv->thumb_map = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, g_free);
+  priv->waiting = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, NULL);
 }
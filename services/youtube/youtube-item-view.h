@@ -23,7 +23,7 @@
 #define _SW_YOUTUBE_ITEM_VIEW
 
 #include <glib-object.h>
-#include <libsocialweb/sw-item-view.h>
+#include "poll-item-view.h"
 
 G_BEGIN_DECLS
 
@@ -45,11 +45,11 @@ G_BEGIN_DECLS
   (G_TYPE_INSTANCE_GET_CLASS ((obj), SW_TYPE_YOUTUBE_ITEM_VIEW, SwYoutubeItemViewClass))
 
 typedef struct {
-  SwItemView parent;
+  SwPollItemView parent;
 } SwYoutubeItemView;
 
 typedef struct {
-  SwItemViewClass parent_class;
+  SwPollItemViewClass parent_class;
 } SwYoutubeItemViewClass;
 
 GType sw_youtube_item_view_get_type (void);
@@ -44,6 +44,9 @@
 
 #include "youtube.h"
 #include "youtube-item-view.h"
+#include "session-store.h"
+#include "http-session.h"
+#include "circuit-breaker.h"
 
 static void initable_iface_init (gpointer g_iface, gpointer iface_data);
 static void query_iface_init (gpointer g_iface, gpointer iface_data);
@@ -59,8 +62,13 @@ G_DEFINE_TYPE_WITH_CODE (SwServiceYoutube,
 #define GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_SERVICE_YOUTUBE, SwServiceYoutubePrivate))
 
+/* ClientLogin tokens are valid for two weeks */
+#define YOUTUBE_SESSION_LIFETIME (14 * 24 * 60 * 60)
+
 struct _SwServiceYoutubePrivate {
   gboolean inited;
+  guint init_id;
+  gboolean activated;
   enum {
     OFFLINE,
     CREDS_INVALID,
@@ -68,6 +76,7 @@ struct _SwServiceYoutubePrivate {
   } credentials;
   RestProxy *proxy;
   RestProxy *auth_proxy;
+  gboolean logging_in;
   char *username;
   char *password;
   char *developer_key;
@@ -114,7 +123,7 @@ get_dynamic_caps (SwService *service)
 
   switch (priv->credentials) {
   case CREDS_VALID:
-    return full_caps;
+    return circuit_breaker_get_caps (priv->proxy, full_caps);
   case CREDS_INVALID:
     return invalid_caps;
   case OFFLINE:
@@ -137,6 +146,31 @@ sw_service_youtube_get_user_auth (SwServiceYoutube *youtube)
   return priv->user_auth;
 }
 
+static void
+clear_session (SwServiceYoutube *youtube)
+{
+  SwServiceYoutubePrivate *priv = GET_PRIVATE (youtube);
+
+  g_free (priv->user_auth);
+  priv->user_auth = NULL;
+  g_free (priv->nickname);
+  priv->nickname = NULL;
+}
+
+static gboolean
+restore_session (SwServiceYoutube *youtube)
+{
+  SwServiceYoutubePrivate *priv = GET_PRIVATE (youtube);
+  gboolean found;
+
+  found = session_store_lookup ("youtube", priv->username,
+                                "auth", &priv->user_auth,
+                                "nickname", &priv->nickname,
+                                NULL);
+
+  return found;
+}
+
 static void
 _got_user_auth (RestProxyCall *call,
                 const GError  *error,
@@ -144,18 +178,24 @@ _got_user_auth (RestProxyCall *call,
                 gpointer       user_data)
 {
   SwService *service = SW_SERVICE (weak_object);
-  SwServiceYoutubePrivate *priv = SW_SERVICE_YOUTUBE (service)->priv;
+  SwServiceYoutube *youtube = SW_SERVICE_YOUTUBE (service);
+  SwServiceYoutubePrivate *priv = youtube->priv;
   const char *message = rest_proxy_call_get_payload (call);
   char **tokens;
 
+  priv->logging_in = FALSE;
+
   if (error) {
     g_message ("Error: %s", error->message);
     g_message ("Error from Youtube: %s", message);
     priv->credentials = CREDS_INVALID;
     sw_service_emit_capabilities_changed (service, get_dynamic_caps (service));
+    g_object_unref (call);
     return;
   }
 
+  clear_session (youtube);
+
   /* Parse the message */
   tokens = g_strsplit_set (message, "=\n", -1);
   if (g_strcmp0 (tokens[0], "Auth") == 0 &&
@@ -164,6 +204,12 @@ _got_user_auth (RestProxyCall *call,
     /*Alright! we got the auth!!!*/
     priv->nickname = g_strdup (tokens[3]);
     priv->credentials = CREDS_VALID;
+
+    session_store_save ("youtube", priv->username,
+                        time (NULL) + YOUTUBE_SESSION_LIFETIME,
+                        "auth", priv->user_auth,
+                        "nickname", priv->nickname,
+                        NULL);
   } else {
     priv->credentials = CREDS_INVALID;
   }
@@ -175,6 +221,38 @@ _got_user_auth (RestProxyCall *call,
   g_object_unref (call);
 }
 
+static void
+login (SwServiceYoutube *youtube)
+{
+  SwServiceYoutubePrivate *priv = GET_PRIVATE (youtube);
+  RestProxyCall *call;
+
+  if (priv->logging_in)
+    return;
+
+  priv->logging_in = TRUE;
+
+  /* request user_auth */
+  /* http://code.google.com/intl/zh-TW/apis/youtube/2.0/developers_guide_protocol_clientlogin.html */
+  call = rest_proxy_new_call (priv->auth_proxy);
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_set_function (call, "ClientLogin");
+  rest_proxy_call_add_params (call,
+                              "Email", priv->username,
+                              "Passwd", priv->password,
+                              "service", "youtube",
+                              "source", "SUSE MeeGo",
+                              NULL);
+  rest_proxy_call_add_header (call,
+                              "Content-Type",
+                              "application/x-www-form-urlencoded");
+  rest_proxy_call_async (call,
+                         (RestProxyCallAsyncCallback)_got_user_auth,
+                         (GObject*)youtube,
+                         NULL,
+                         NULL);
+}
+
 static void
 online_notify (gboolean online, gpointer user_data)
 {
@@ -185,27 +263,14 @@ online_notify (gboolean online, gpointer user_data)
 
   if (online) {
     if (priv->username && priv->password) {
-      RestProxyCall *call;
-
-      /* request user_auth */
-      /* http://code.google.com/intl/zh-TW/apis/youtube/2.0/developers_guide_protocol_clientlogin.html */
-      call = rest_proxy_new_call (priv->auth_proxy);
-      rest_proxy_call_set_method (call, "POST");
-      rest_proxy_call_set_function (call, "ClientLogin");
-      rest_proxy_call_add_params (call,
-                                  "Email", priv->username,
-                                  "Passwd", priv->password,
-                                  "service", "youtube",
-                                  "source", "SUSE MeeGo",
-                                  NULL);
-      rest_proxy_call_add_header (call,
-                                  "Content-Type",
-                                  "application/x-www-form-urlencoded");
-      rest_proxy_call_async (call,
-                             (RestProxyCallAsyncCallback)_got_user_auth,
-                             (GObject*)youtube,
-                             NULL,
-                             NULL);
+      /* Reuse the token we have, or the one from the last run */
+      if (priv->user_auth || restore_session (youtube)) {
+        priv->credentials = CREDS_VALID;
+        sw_service_emit_capabilities_changed ((SwService *)youtube,
+                                              get_dynamic_caps ((SwService *)youtube));
+      } else if (priv->activated) {
+        login (youtube);
+      }
     }
   } else {
     sw_service_emit_capabilities_changed ((SwService *)youtube,
@@ -213,6 +278,28 @@ online_notify (gboolean online, gpointer user_data)
   }
 }
 
+/*
+ * YouTube rejected the token, so forget it and log in again.
+ */
+void
+sw_service_youtube_invalidate_session (SwServiceYoutube *youtube)
+{
+  SwServiceYoutubePrivate *priv = GET_PRIVATE (youtube);
+
+  clear_session (youtube);
+  session_store_forget ("youtube");
+
+  if (priv->credentials != CREDS_VALID)
+    return;
+
+  priv->credentials = OFFLINE;
+  sw_service_emit_capabilities_changed ((SwService *)youtube,
+                                        get_dynamic_caps ((SwService *)youtube));
+
+  if (sw_is_online ())
+    online_notify (TRUE, youtube);
+}
+
 /*
  * Callback from the keyring lookup in refresh_credentials.
  */
@@ -228,12 +315,24 @@ found_password_cb (GnomeKeyringResult  result,
   if (result == GNOME_KEYRING_RESULT_OK && list != NULL) {
     GnomeKeyringNetworkPasswordData *data = list->data;
 
+    /* Nothing to do if the account didn't change and is logged in */
+    if (g_strcmp0 (priv->username, data->user) == 0 &&
+        g_strcmp0 (priv->password, data->password) == 0 &&
+        priv->credentials == CREDS_VALID)
+      return;
+
+    /* A stored session belongs to the account it was made with */
+    if (priv->username)
+      session_store_forget ("youtube");
+
     g_free (priv->username);
     g_free (priv->password);
 
     priv->username = g_strdup (data->user);
     priv->password = g_strdup (data->password);
 
+    clear_session (youtube);
+
     /* If we're online, force a reconnect to fetch new credentials */
     if (sw_is_online ()) {
       online_notify (FALSE, service);
@@ -246,6 +345,8 @@ found_password_cb (GnomeKeyringResult  result,
     priv->password = NULL;
     priv->credentials = OFFLINE;
 
+    clear_session (youtube);
+
     if (result != GNOME_KEYRING_RESULT_NO_MATCH) {
       g_warning (G_STRLOC ": Error getting password: %s", gnome_keyring_result_to_message (result));
     }
@@ -271,6 +372,9 @@ refresh_credentials (SwServiceYoutube *youtube)
 static void
 credentials_updated (SwService *service)
 {
+  /* The user just changed the account, so verify it straight away */
+  GET_PRIVATE (service)->activated = TRUE;
+
   refresh_credentials (SW_SERVICE_YOUTUBE (service));
 }
 
@@ -287,6 +391,11 @@ sw_service_youtube_dispose (GObject *object)
 
   sw_online_remove_notify (online_notify, object);
 
+  if (priv->init_id) {
+    g_source_remove (priv->init_id);
+    priv->init_id = 0;
+  }
+
   if (priv->proxy) {
     g_object_unref (priv->proxy);
     priv->proxy = NULL;
@@ -343,6 +452,39 @@ sw_service_youtube_init (SwServiceYoutube *self)
   self->priv->nickname = NULL;
 }
 
+/*
+ * The keyring lookups are deferred to an idle so that the daemon can load
+ * every module first and the lookups of all services run concurrently.
+ */
+static gboolean
+deferred_init_cb (gpointer user_data)
+{
+  SwServiceYoutube *youtube = SW_SERVICE_YOUTUBE (user_data);
+
+  youtube->priv->init_id = 0;
+  refresh_credentials (youtube);
+
+  return FALSE;
+}
+
+/*
+ * Logging in waits until a client actually needs the service, so a cold
+ * start doesn't pay for logins nobody asked for.
+ */
+static void
+activate (SwServiceYoutube *youtube)
+{
+  SwServiceYoutubePrivate *priv = GET_PRIVATE (youtube);
+
+  if (priv->activated)
+    return;
+
+  priv->activated = TRUE;
+
+  if (sw_is_online () && priv->credentials != CREDS_VALID)
+    online_notify (TRUE, youtube);
+}
+
 /* Initable interface */
 
 static gboolean
@@ -368,13 +510,16 @@ sw_service_youtube_initable (GInitable    *initable,
 
   priv->proxy = rest_proxy_new ("http://gdata.youtube.com/feeds/api/", FALSE);
   priv->auth_proxy = rest_proxy_new ("https://www.google.com/youtube/accounts/", FALSE);
+  http_session_setup (priv->proxy, "youtube");
+  circuit_breaker_attach (priv->proxy, SW_SERVICE (youtube));
+  http_session_setup (priv->auth_proxy, "youtube");
 
   priv->developer_key = (char *)key;
   priv->credentials = OFFLINE;
   
   sw_online_add_notify (online_notify, youtube);
 
-  refresh_credentials (youtube);
+  priv->init_id = g_idle_add (deferred_init_cb, youtube);
 
   priv->inited = TRUE;
 
@@ -426,6 +571,8 @@ _youtube_query_open_view (SwQueryIface          *self,
     return;
   }
 
+  activate (SW_SERVICE_YOUTUBE (self));
+
   item_view = g_object_new (SW_TYPE_YOUTUBE_ITEM_VIEW,
                             "proxy", priv->proxy,
                             "developer_key", priv->developer_key,
@@ -57,6 +57,7 @@ typedef struct {
 GType sw_service_youtube_get_type (void);
 
 const char* sw_service_youtube_get_user_auth (SwServiceYoutube *youtube);
+void sw_service_youtube_invalidate_session (SwServiceYoutube *youtube);
 
 G_END_DECLS
 
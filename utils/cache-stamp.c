@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "cache-stamp.h"
+
+/*
+ * The libsocialweb cache doesn't record when a set was fetched, so the time of
+ * the last successful fetch of every query is kept next to it, in a key file
+ * per service.
+ */
+
+#define STAMP_GROUP "Stamps"
+
+static char *
+get_stamp_filename (const char *service)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "libsocialweb", "stamps", service, NULL);
+}
+
+static gint
+compare_keys (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const char **)a, *(const char **)b);
+}
+
+/*
+ * The key identifying a query and its parameters, independent of the order
+ * of the parameters in the hash table.
+ */
+static char *
+get_stamp_key (const char *query, GHashTable *params)
+{
+  GString *string;
+  GPtrArray *keys;
+  GHashTableIter iter;
+  gpointer key;
+  char *hash;
+  guint i;
+
+  string = g_string_new (query);
+
+  if (params) {
+    keys = g_ptr_array_new ();
+    g_hash_table_iter_init (&iter, params);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+      g_ptr_array_add (keys, key);
+    g_ptr_array_sort (keys, compare_keys);
+
+    for (i = 0; i < keys->len; i++) {
+      key = g_ptr_array_index (keys, i);
+      g_string_append_printf (string, "&%s=%s", (char *)key,
+                              (char *)g_hash_table_lookup (params, key));
+    }
+    g_ptr_array_free (keys, TRUE);
+  }
+
+  hash = g_compute_checksum_for_string (G_CHECKSUM_MD5, string->str, -1);
+  g_string_free (string, TRUE);
+
+  return hash;
+}
+
+void
+cache_stamp_touch (const char *service,
+                   const char *query,
+                   GHashTable *params)
+{
+  GKeyFile *keyfile;
+  GError *error = NULL;
+  char *filename, *dirname, *key, *data;
+  gsize length;
+
+  g_return_if_fail (service && query);
+
+  filename = get_stamp_filename (service);
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+
+  keyfile = g_key_file_new ();
+  g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, NULL);
+
+  key = get_stamp_key (query, params);
+  g_key_file_set_int64 (keyfile, STAMP_GROUP, key, time (NULL));
+
+  data = g_key_file_to_data (keyfile, &length, NULL);
+  if (!g_file_set_contents (filename, data, length, &error)) {
+    g_message ("Error: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+  g_free (key);
+  g_key_file_free (keyfile);
+  g_free (dirname);
+  g_free (filename);
+}
+
+/*
+ * Returns the age in seconds of the cached set for @query, or -1 if it is not
+ * known when it was fetched.
+ */
+gint64
+cache_stamp_get_age (const char *service,
+                     const char *query,
+                     GHashTable *params)
+{
+  GKeyFile *keyfile;
+  GError *error = NULL;
+  char *filename, *key;
+  gint64 stamp, age = -1;
+
+  g_return_val_if_fail (service && query, -1);
+
+  keyfile = g_key_file_new ();
+  filename = get_stamp_filename (service);
+
+  if (g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, NULL)) {
+    key = get_stamp_key (query, params);
+    stamp = g_key_file_get_int64 (keyfile, STAMP_GROUP, key, &error);
+    if (error)
+      g_error_free (error);
+    else if (stamp <= time (NULL))
+      age = time (NULL) - stamp;
+    g_free (key);
+  }
+
+  g_key_file_free (keyfile);
+  g_free (filename);
+
+  return age;
+}
+
+void
+cache_stamp_drop_all (const char *service)
+{
+  char *filename;
+
+  g_return_if_fail (service);
+
+  filename = get_stamp_filename (service);
+  g_unlink (filename);
+  g_free (filename);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#ifndef _CACHE_STAMP_H_
+#define _CACHE_STAMP_H_
+
+/* Cached items older than this, in seconds, are not worth showing */
+#define CACHE_STAMP_MAX_AGE (24 * 60 * 60)
+
+void   cache_stamp_touch    (const char *service,
+                             const char *query,
+                             GHashTable *params);
+gint64 cache_stamp_get_age  (const char *service,
+                             const char *query,
+                             GHashTable *params);
+void   cache_stamp_drop_all (const char *service);
+
+#endif /* _CACHE_STAMP_H_ */
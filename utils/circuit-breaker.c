@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <glib-object.h>
+#include <rest/rest-proxy.h>
+#include <rest/rest-proxy-call.h>
+#include <libsocialweb/sw-service.h>
+#include "circuit-breaker.h"
+
+/*
+ * One breaker per endpoint of a proxy.  A breaker opens after a few
+ * consecutive failures, and while it is open the views don't poll that
+ * endpoint at all and keep serving what they have.  Once the open period
+ * has passed a single probe is let through: if it succeeds the breaker
+ * closes, otherwise it stays open for twice as long, up to an hour.
+ *
+ * Only transport errors and server errors count as failures; a rejected
+ * login or a bad request says nothing about the service being down.
+ */
+
+#define CIRCUIT_BREAKER_KEY "sw-circuit-breakers"
+#define FAILURE_THRESHOLD 3
+#define MIN_OPEN_PERIOD (5 * 60)
+#define MAX_OPEN_PERIOD (60 * 60)
+
+typedef struct {
+  guint failures;
+  gboolean open;
+  /* A half-open probe has been let through */
+  gboolean probing;
+  guint open_period;
+  gint64 retry_at;
+} CircuitBreaker;
+
+typedef struct {
+  SwService *service;
+  GHashTable *breakers;
+  /* The service caps with SERVICE_UNAVAILABLE added, by the original */
+  GHashTable *open_caps;
+  guint n_open;
+} CircuitBreakerSet;
+
+static void
+breaker_set_free (CircuitBreakerSet *set)
+{
+  if (set->service)
+    g_object_remove_weak_pointer (G_OBJECT (set->service),
+                                  (gpointer *)&set->service);
+
+  g_hash_table_destroy (set->breakers);
+  g_hash_table_destroy (set->open_caps);
+  g_slice_free (CircuitBreakerSet, set);
+}
+
+static CircuitBreaker *
+get_breaker (RestProxy          *proxy,
+             const char         *endpoint,
+             CircuitBreakerSet **set_out)
+{
+  CircuitBreakerSet *set;
+  CircuitBreaker *breaker;
+
+  set = g_object_get_data (G_OBJECT (proxy), CIRCUIT_BREAKER_KEY);
+  if (set == NULL)
+    return NULL;
+
+  breaker = g_hash_table_lookup (set->breakers, endpoint);
+  if (breaker == NULL) {
+    breaker = g_slice_new0 (CircuitBreaker);
+    g_hash_table_insert (set->breakers, g_strdup (endpoint), breaker);
+  }
+
+  if (set_out)
+    *set_out = set;
+
+  return breaker;
+}
+
+static void
+breaker_free (gpointer data)
+{
+  g_slice_free (CircuitBreaker, data);
+}
+
+static void
+notify_caps (CircuitBreakerSet *set)
+{
+  SwService *service = set->service;
+
+  if (service == NULL)
+    return;
+
+  sw_service_emit_capabilities_changed
+    (service, SW_SERVICE_GET_CLASS (service)->get_dynamic_caps (service));
+}
+
+void
+circuit_breaker_attach (RestProxy *proxy,
+                        SwService *service)
+{
+  CircuitBreakerSet *set;
+
+  g_return_if_fail (REST_IS_PROXY (proxy));
+  g_return_if_fail (SW_IS_SERVICE (service));
+
+  set = g_slice_new0 (CircuitBreakerSet);
+  set->service = service;
+  g_object_add_weak_pointer (G_OBJECT (service), (gpointer *)&set->service);
+  set->breakers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, breaker_free);
+  set->open_caps = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  g_object_set_data_full (G_OBJECT (proxy), CIRCUIT_BREAKER_KEY,
+                          set, (GDestroyNotify)breaker_set_free);
+}
+
+gboolean
+circuit_breaker_allow (RestProxy  *proxy,
+                       const char *endpoint)
+{
+  CircuitBreaker *breaker;
+
+  breaker = get_breaker (proxy, endpoint, NULL);
+  if (breaker == NULL || !breaker->open)
+    return TRUE;
+
+  if (time (NULL) < breaker->retry_at)
+    return FALSE;
+
+  /* Let another probe through if this one never comes back */
+  breaker->probing = TRUE;
+  breaker->retry_at = time (NULL) + MIN_OPEN_PERIOD;
+
+  return TRUE;
+}
+
+gboolean
+circuit_breaker_is_open (RestProxy  *proxy,
+                         const char *endpoint)
+{
+  CircuitBreaker *breaker;
+
+  breaker = get_breaker (proxy, endpoint, NULL);
+
+  return breaker && breaker->open;
+}
+
+void
+circuit_breaker_record (RestProxy     *proxy,
+                        const char    *endpoint,
+                        RestProxyCall *call,
+                        const GError  *error)
+{
+  CircuitBreakerSet *set;
+  CircuitBreaker *breaker;
+  guint status;
+
+  breaker = get_breaker (proxy, endpoint, &set);
+  if (breaker == NULL)
+    return;
+
+  status = rest_proxy_call_get_status_code (call);
+
+  if (error == NULL || (status >= 100 && status < 500)) {
+    breaker->failures = 0;
+    breaker->open_period = 0;
+    breaker->probing = FALSE;
+
+    if (breaker->open) {
+      g_message ("%s is back", endpoint);
+      breaker->open = FALSE;
+      if (--set->n_open == 0)
+        notify_caps (set);
+    }
+    return;
+  }
+
+  breaker->failures++;
+
+  if (breaker->open) {
+    if (breaker->probing) {
+      breaker->probing = FALSE;
+      breaker->open_period = MIN (breaker->open_period * 2, MAX_OPEN_PERIOD);
+      breaker->retry_at = time (NULL) + breaker->open_period;
+    }
+  } else if (breaker->failures >= FAILURE_THRESHOLD) {
+    g_message ("%s failed %u times in a row, pausing it",
+               endpoint, breaker->failures);
+    breaker->open = TRUE;
+    breaker->open_period = MIN_OPEN_PERIOD;
+    breaker->retry_at = time (NULL) + breaker->open_period;
+    if (set->n_open++ == 0)
+      notify_caps (set);
+  }
+}
+
+const char **
+circuit_breaker_get_caps (RestProxy   *proxy,
+                          const char **caps)
+{
+  CircuitBreakerSet *set;
+  const char **open_caps;
+  guint n;
+
+  set = g_object_get_data (G_OBJECT (proxy), CIRCUIT_BREAKER_KEY);
+  if (set == NULL || set->n_open == 0)
+    return caps;
+
+  /* The callers hand out static arrays, so keep ours alive as long */
+  open_caps = g_hash_table_lookup (set->open_caps, caps);
+  if (open_caps == NULL) {
+    n = g_strv_length ((char **)caps);
+    open_caps = g_new0 (const char *, n + 2);
+    memcpy (open_caps, caps, n * sizeof (char *));
+    open_caps[n] = SERVICE_UNAVAILABLE;
+    g_hash_table_insert (set->open_caps, caps, open_caps);
+  }
+
+  return open_caps;
+}
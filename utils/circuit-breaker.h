@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rest/rest-proxy.h>
+#include <rest/rest-proxy-call.h>
+#include <libsocialweb/sw-service.h>
+
+#ifndef _CIRCUIT_BREAKER_H_
+#define _CIRCUIT_BREAKER_H_
+
+/* Added to the dynamic caps while any endpoint of the service is failing */
+#define SERVICE_UNAVAILABLE "x-service-unavailable"
+
+void         circuit_breaker_attach   (RestProxy     *proxy,
+                                       SwService     *service);
+gboolean     circuit_breaker_allow    (RestProxy     *proxy,
+                                       const char    *endpoint);
+gboolean     circuit_breaker_is_open  (RestProxy     *proxy,
+                                       const char    *endpoint);
+void         circuit_breaker_record   (RestProxy     *proxy,
+                                       const char    *endpoint,
+                                       RestProxyCall *call,
+                                       const GError  *error);
+const char **circuit_breaker_get_caps (RestProxy     *proxy,
+                                       const char   **caps);
+
+#endif /* _CIRCUIT_BREAKER_H_ */
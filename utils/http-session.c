@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib-object.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <rest/rest-proxy.h>
+#include "http-session.h"
+
+/*
+ * RestProxy creates its own SoupSession, so the sessions can't be shared
+ * between proxies.  Instead every proxy of a service gets the same session
+ * feature, which tunes each session as it is attached: the item views poll
+ * with a couple of calls at a time, and keeping a few connections per host
+ * open lets the next poll go out over a warm connection instead of paying
+ * for a new TCP handshake each time.
+ *
+ * The feature also adds a content decoder so that responses are requested
+ * compressed, and counts the bytes received on the wire against the bytes
+ * after decoding.  The totals are added to a key file in the user cache
+ * directory, one group per service, so the saving can be checked.
+ */
+
+#define HTTP_MAX_CONNS 16
+#define HTTP_MAX_CONNS_PER_HOST 4
+/* Long enough to outlive the item view poll interval */
+#define HTTP_IDLE_TIMEOUT (6 * 60)
+/* Give up on a stalled request rather than block the view forever */
+#define HTTP_IO_TIMEOUT 60
+/* Traffic counts are written out at most this often */
+#define HTTP_TRAFFIC_SAVE_DELAY 60
+
+typedef struct {
+  GObject parent;
+  char *service;
+  /* Not yet written to the traffic file */
+  gint64 wire_bytes;
+  gint64 decoded_bytes;
+  guint save_id;
+} HttpSessionTuner;
+
+typedef GObjectClass HttpSessionTunerClass;
+
+static void http_session_tuner_feature_init (SoupSessionFeatureInterface *iface,
+                                             gpointer                     iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (HttpSessionTuner,
+                         http_session_tuner,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (SOUP_TYPE_SESSION_FEATURE,
+                                                http_session_tuner_feature_init));
+
+static char *
+get_traffic_filename (void)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "libsocialweb", "traffic", NULL);
+}
+
+static gboolean
+save_traffic_cb (gpointer user_data)
+{
+  HttpSessionTuner *tuner = user_data;
+  GKeyFile *keyfile;
+  GError *error = NULL;
+  char *filename, *dirname, *data;
+  gint64 wire, decoded;
+  gsize length;
+
+  tuner->save_id = 0;
+
+  filename = get_traffic_filename ();
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+
+  keyfile = g_key_file_new ();
+  g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, NULL);
+
+  wire = g_key_file_get_int64 (keyfile, tuner->service, "Received", NULL);
+  decoded = g_key_file_get_int64 (keyfile, tuner->service, "Decoded", NULL);
+  g_key_file_set_int64 (keyfile, tuner->service, "Received",
+                        wire + tuner->wire_bytes);
+  g_key_file_set_int64 (keyfile, tuner->service, "Decoded",
+                        decoded + tuner->decoded_bytes);
+  tuner->wire_bytes = tuner->decoded_bytes = 0;
+
+  data = g_key_file_to_data (keyfile, &length, NULL);
+  if (!g_file_set_contents (filename, data, length, &error)) {
+    g_message ("Error: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+  g_key_file_free (keyfile);
+  g_free (dirname);
+  g_free (filename);
+
+  return FALSE;
+}
+
+static void
+got_body_cb (SoupMessage      *msg,
+             HttpSessionTuner *tuner)
+{
+  gint64 decoded, wire;
+
+  decoded = msg->response_body->length;
+
+  /* Without a Content-Length the encoded size isn't known, so count the
+   * response as uncompressed rather than guess */
+  if (soup_message_headers_get_encoding (msg->response_headers) ==
+      SOUP_ENCODING_CONTENT_LENGTH)
+    wire = soup_message_headers_get_content_length (msg->response_headers);
+  else
+    wire = decoded;
+
+  g_debug ("%s: received %" G_GINT64_FORMAT " bytes, %" G_GINT64_FORMAT
+           " decoded", tuner->service, wire, decoded);
+
+  tuner->wire_bytes += wire;
+  tuner->decoded_bytes += decoded;
+
+  if (tuner->save_id == 0)
+    tuner->save_id = g_timeout_add_seconds (HTTP_TRAFFIC_SAVE_DELAY,
+                                            save_traffic_cb, tuner);
+}
+
+static void
+request_queued_cb (SoupSession      *session,
+                   SoupMessage      *msg,
+                   HttpSessionTuner *tuner)
+{
+  g_signal_connect_object (msg, "got-body",
+                           G_CALLBACK (got_body_cb), tuner, 0);
+}
+
+static void
+http_session_tuner_attach (SoupSessionFeature *feature,
+                           SoupSession        *session)
+{
+  g_object_set (session,
+                SOUP_SESSION_MAX_CONNS, HTTP_MAX_CONNS,
+                SOUP_SESSION_MAX_CONNS_PER_HOST, HTTP_MAX_CONNS_PER_HOST,
+                SOUP_SESSION_IDLE_TIMEOUT, HTTP_IDLE_TIMEOUT,
+                SOUP_SESSION_TIMEOUT, HTTP_IO_TIMEOUT,
+                NULL);
+
+  /* Adds Accept-Encoding to every request and inflates the responses */
+  soup_session_add_feature_by_type (session, SOUP_TYPE_CONTENT_DECODER);
+
+  g_signal_connect (session, "request-queued",
+                    G_CALLBACK (request_queued_cb), feature);
+}
+
+static void
+http_session_tuner_detach (SoupSessionFeature *feature,
+                           SoupSession        *session)
+{
+  g_signal_handlers_disconnect_by_func (session, request_queued_cb, feature);
+}
+
+static void
+http_session_tuner_feature_init (SoupSessionFeatureInterface *iface,
+                                 gpointer                     iface_data)
+{
+  iface->attach = http_session_tuner_attach;
+  iface->detach = http_session_tuner_detach;
+}
+
+static void
+http_session_tuner_finalize (GObject *object)
+{
+  HttpSessionTuner *tuner = (HttpSessionTuner *)object;
+
+  if (tuner->save_id) {
+    g_source_remove (tuner->save_id);
+    save_traffic_cb (tuner);
+  }
+
+  g_free (tuner->service);
+
+  G_OBJECT_CLASS (http_session_tuner_parent_class)->finalize (object);
+}
+
+static void
+http_session_tuner_class_init (HttpSessionTunerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = http_session_tuner_finalize;
+}
+
+static void
+http_session_tuner_init (HttpSessionTuner *self)
+{
+}
+
+void
+http_session_setup (RestProxy  *proxy,
+                    const char *service)
+{
+  static GHashTable *tuners = NULL;
+  HttpSessionTuner *tuner;
+
+  g_return_if_fail (REST_IS_PROXY (proxy));
+  g_return_if_fail (service);
+
+  if (tuners == NULL)
+    tuners = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                    g_free, g_object_unref);
+
+  tuner = g_hash_table_lookup (tuners, service);
+  if (tuner == NULL) {
+    tuner = g_object_new (http_session_tuner_get_type (), NULL);
+    tuner->service = g_strdup (service);
+    g_hash_table_insert (tuners, g_strdup (service), tuner);
+  }
+
+  rest_proxy_add_soup_feature (proxy, SOUP_SESSION_FEATURE (tuner));
+}
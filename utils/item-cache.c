@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsocialweb/sw-item.h>
+#include <libsocialweb/sw-utils.h>
+#include <libsocialweb/sw-cache.h>
+#include "item-cache.h"
+
+/*
+ * Item sets are cached in a binary file per query which is mapped into memory
+ * when loaded, so nothing has to be parsed.  The file is written in the host
+ * byte order and laid out as:
+ *
+ *   ItemCacheHeader
+ *   ItemCacheItem[n_items]     the properties of each item
+ *   ItemCacheProp[n_props]     key and value of each property
+ *   guint32[n_strings]         offset of each string in the data
+ *   char[data_length]          the strings, each terminated by a NUL
+ *
+ * Keys and values are stored only once however many items use them.
+ * Readers reject files with a different magic or version.
+ */
+
+#define ITEM_CACHE_MAGIC "SWIC"
+#define ITEM_CACHE_VERSION 1
+
+typedef struct {
+  char magic[4];
+  guint32 version;
+  guint32 n_items;
+  guint32 n_props;
+  guint32 n_strings;
+  guint32 items_offset;
+  guint32 props_offset;
+  guint32 strings_offset;
+  guint32 data_offset;
+  guint32 data_length;
+} ItemCacheHeader;
+
+typedef struct {
+  guint32 first_prop;
+  guint32 n_props;
+} ItemCacheItem;
+
+typedef struct {
+  guint32 key;
+  guint32 value;
+} ItemCacheProp;
+
+typedef struct {
+  GArray *items;
+  GArray *props;
+  GArray *offsets;
+  GString *data;
+  GHashTable *strings;
+} ItemCacheWriter;
+
+static char *
+get_cache_dirname (SwService *service)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "libsocialweb", "items",
+                           sw_service_get_name (service), NULL);
+}
+
+static char *
+get_cache_filename (SwService  *service,
+                    const char *query,
+                    GHashTable *params)
+{
+  char *dirname, *hash, *basename, *filename;
+
+  dirname = get_cache_dirname (service);
+  hash = params ? sw_hash_string_dict (params) : g_strdup ("none");
+  basename = g_strconcat (query, "-", hash, ".bin", NULL);
+  filename = g_build_filename (dirname, basename, NULL);
+
+  g_free (basename);
+  g_free (hash);
+  g_free (dirname);
+
+  return filename;
+}
+
+static guint32
+writer_add_string (ItemCacheWriter *writer, const char *string)
+{
+  gpointer index;
+  guint32 offset;
+
+  if (g_hash_table_lookup_extended (writer->strings, string, NULL, &index))
+    return GPOINTER_TO_UINT (index);
+
+  offset = writer->data->len;
+  g_array_append_val (writer->offsets, offset);
+  g_string_append_len (writer->data, string, strlen (string) + 1);
+
+  index = GUINT_TO_POINTER (writer->offsets->len - 1);
+  g_hash_table_insert (writer->strings, (gpointer)string, index);
+
+  return GPOINTER_TO_UINT (index);
+}
+
+static void
+writer_add_item (gpointer data, gpointer user_data)
+{
+  SwItem *item = SW_ITEM (data);
+  ItemCacheWriter *writer = user_data;
+  ItemCacheItem entry;
+  ItemCacheProp prop;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  entry.first_prop = writer->props->len;
+  entry.n_props = 0;
+
+  g_hash_table_iter_init (&iter, sw_item_peek_hash (item));
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    if (value == NULL)
+      continue;
+
+    prop.key = writer_add_string (writer, key);
+    prop.value = writer_add_string (writer, value);
+    g_array_append_val (writer->props, prop);
+    entry.n_props++;
+  }
+
+  g_array_append_val (writer->items, entry);
+}
+
+void
+item_cache_save (SwService  *service,
+                 const char *query,
+                 GHashTable *params,
+                 SwSet      *set)
+{
+  ItemCacheWriter writer;
+  ItemCacheHeader header;
+  GString *contents;
+  GError *error = NULL;
+  char *dirname, *filename;
+
+  g_return_if_fail (SW_IS_SERVICE (service));
+  g_return_if_fail (query);
+
+  writer.items = g_array_new (FALSE, FALSE, sizeof (ItemCacheItem));
+  writer.props = g_array_new (FALSE, FALSE, sizeof (ItemCacheProp));
+  writer.offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+  writer.data = g_string_new (NULL);
+  writer.strings = g_hash_table_new (g_str_hash, g_str_equal);
+
+  sw_set_foreach (set, writer_add_item, &writer);
+
+  memcpy (header.magic, ITEM_CACHE_MAGIC, sizeof (header.magic));
+  header.version = ITEM_CACHE_VERSION;
+  header.n_items = writer.items->len;
+  header.n_props = writer.props->len;
+  header.n_strings = writer.offsets->len;
+  header.items_offset = sizeof (ItemCacheHeader);
+  header.props_offset = header.items_offset + header.n_items * sizeof (ItemCacheItem);
+  header.strings_offset = header.props_offset + header.n_props * sizeof (ItemCacheProp);
+  header.data_offset = header.strings_offset + header.n_strings * sizeof (guint32);
+  header.data_length = writer.data->len;
+
+  contents = g_string_sized_new (header.data_offset + header.data_length);
+  g_string_append_len (contents, (char *)&header, sizeof (header));
+  g_string_append_len (contents, writer.items->data,
+                       header.n_items * sizeof (ItemCacheItem));
+  g_string_append_len (contents, writer.props->data,
+                       header.n_props * sizeof (ItemCacheProp));
+  g_string_append_len (contents, writer.offsets->data,
+                       header.n_strings * sizeof (guint32));
+  g_string_append_len (contents, writer.data->str, writer.data->len);
+
+  dirname = get_cache_dirname (service);
+  g_mkdir_with_parents (dirname, 0700);
+  filename = get_cache_filename (service, query, params);
+
+  /* The file is replaced rather than rewritten, so existing maps stay valid */
+  if (!g_file_set_contents (filename, contents->str, contents->len, &error)) {
+    g_message ("Error: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (filename);
+  g_free (dirname);
+  g_string_free (contents, TRUE);
+  g_hash_table_destroy (writer.strings);
+  g_string_free (writer.data, TRUE);
+  g_array_free (writer.offsets, TRUE);
+  g_array_free (writer.props, TRUE);
+  g_array_free (writer.items, TRUE);
+}
+
+static gboolean
+check_contents (const char *contents, gsize length)
+{
+  const ItemCacheHeader *header = (const ItemCacheHeader *)contents;
+  const ItemCacheItem *items;
+  const ItemCacheProp *props;
+  const guint32 *offsets;
+  guint32 i;
+
+  if (length < sizeof (ItemCacheHeader) ||
+      memcmp (header->magic, ITEM_CACHE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != ITEM_CACHE_VERSION)
+    return FALSE;
+
+  if ((guint64)header->items_offset + (guint64)header->n_items * sizeof (ItemCacheItem) > length ||
+      (guint64)header->props_offset + (guint64)header->n_props * sizeof (ItemCacheProp) > length ||
+      (guint64)header->strings_offset + (guint64)header->n_strings * sizeof (guint32) > length ||
+      (guint64)header->data_offset + header->data_length > length)
+    return FALSE;
+
+  if (header->items_offset % 4 || header->props_offset % 4 ||
+      header->strings_offset % 4)
+    return FALSE;
+
+  /* Every string ends before the data does */
+  if (header->n_strings &&
+      (header->data_length == 0 ||
+       contents[header->data_offset + header->data_length - 1] != '\0'))
+    return FALSE;
+
+  items = (const ItemCacheItem *)(contents + header->items_offset);
+  for (i = 0; i < header->n_items; i++) {
+    if ((guint64)items[i].first_prop + items[i].n_props > header->n_props)
+      return FALSE;
+  }
+
+  props = (const ItemCacheProp *)(contents + header->props_offset);
+  for (i = 0; i < header->n_props; i++) {
+    if (props[i].key >= header->n_strings || props[i].value >= header->n_strings)
+      return FALSE;
+  }
+
+  offsets = (const guint32 *)(contents + header->strings_offset);
+  for (i = 0; i < header->n_strings; i++) {
+    if (offsets[i] >= header->data_length)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+SwSet *
+item_cache_load (SwService  *service,
+                 const char *query,
+                 GHashTable *params)
+{
+  const ItemCacheHeader *header;
+  const ItemCacheItem *items;
+  const ItemCacheProp *props;
+  const guint32 *offsets;
+  const char *contents, *data, *id;
+  GMappedFile *map;
+  SwSet *set = NULL;
+  char *filename;
+  guint32 i, j;
+
+  g_return_val_if_fail (SW_IS_SERVICE (service), NULL);
+  g_return_val_if_fail (query, NULL);
+
+  filename = get_cache_filename (service, query, params);
+  map = g_mapped_file_new (filename, FALSE, NULL);
+  if (map == NULL)
+    goto done;
+
+  contents = g_mapped_file_get_contents (map);
+  if (!check_contents (contents, g_mapped_file_get_length (map))) {
+    g_message ("Ignoring invalid cache %s", filename);
+    goto done;
+  }
+
+  header = (const ItemCacheHeader *)contents;
+  items = (const ItemCacheItem *)(contents + header->items_offset);
+  props = (const ItemCacheProp *)(contents + header->props_offset);
+  offsets = (const guint32 *)(contents + header->strings_offset);
+  data = contents + header->data_offset;
+
+#define STRING(index) (data + offsets[index])
+
+  set = sw_item_set_new ();
+
+  for (i = 0; i < header->n_items; i++) {
+    const ItemCacheProp *first = props + items[i].first_prop;
+    SwItem *item;
+
+    /* Items banned since they were cached are never built */
+    id = NULL;
+    for (j = 0; j < items[i].n_props; j++) {
+      if (strcmp (STRING (first[j].key), "id") == 0) {
+        id = STRING (first[j].value);
+        break;
+      }
+    }
+
+    if (id && sw_service_is_uid_banned (service, id))
+      continue;
+
+    item = sw_item_new ();
+    sw_item_set_service (item, service);
+
+    for (j = 0; j < items[i].n_props; j++)
+      sw_item_put (item, STRING (first[j].key), STRING (first[j].value));
+
+    sw_set_add (set, (GObject *)item);
+    g_object_unref (item);
+  }
+
+#undef STRING
+
+ done:
+  if (map)
+    g_mapped_file_unref (map);
+  g_free (filename);
+
+  return set;
+}
+
+/*
+ * Remove every cached set of @service, including those left in the keyfile
+ * format libsocialweb's own cache used before, so nothing of the previous
+ * user stays on disk.
+ */
+void
+item_cache_drop_all (SwService *service)
+{
+  GDir *dir;
+  const char *name;
+  char *dirname, *filename;
+
+  g_return_if_fail (SW_IS_SERVICE (service));
+
+  dirname = get_cache_dirname (service);
+
+  dir = g_dir_open (dirname, 0, NULL);
+  if (dir) {
+    while ((name = g_dir_read_name (dir)) != NULL) {
+      filename = g_build_filename (dirname, name, NULL);
+      g_unlink (filename);
+      g_free (filename);
+    }
+    g_dir_close (dir);
+  }
+
+  g_free (dirname);
+
+  sw_cache_drop_all (service);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <libsocialweb/sw-service.h>
+#include <libsocialweb/sw-set.h>
+
+#ifndef _ITEM_CACHE_H_
+#define _ITEM_CACHE_H_
+
+void   item_cache_save     (SwService  *service,
+                            const char *query,
+                            GHashTable *params,
+                            SwSet      *set);
+SwSet *item_cache_load     (SwService  *service,
+                            const char *query,
+                            GHashTable *params);
+void   item_cache_drop_all (SwService  *service);
+
+#endif /* _ITEM_CACHE_H_ */
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include "json-scan.h"
+
+/*
+ * A pull scanner for JSON: it hands out one token at a time straight from
+ * the payload and builds no tree, so a parser that only wants a few members
+ * of each entry reads those and skips over the rest without allocating
+ * anything for them.  Strings have their escapes decoded; numbers are kept
+ * as the text they were written with, so ids too large for a double come
+ * through intact.  The separators are checked only loosely, which is enough
+ * to reject a payload that isn't JSON at all.
+ */
+
+void
+json_scan_init (JsonScan   *scan,
+                const char *data,
+                gsize       length)
+{
+  scan->p = data;
+  scan->end = data + length;
+  scan->text = g_string_sized_new (64);
+}
+
+void
+json_scan_clear (JsonScan *scan)
+{
+  g_string_free (scan->text, TRUE);
+  scan->text = NULL;
+}
+
+/* The text of the key, string or number just returned */
+const char *
+json_scan_text (JsonScan *scan)
+{
+  return scan->text->str;
+}
+
+static void
+skip_space (JsonScan *scan)
+{
+  while (scan->p < scan->end &&
+         (*scan->p == ' ' || *scan->p == '\t' ||
+          *scan->p == '\n' || *scan->p == '\r'))
+    scan->p++;
+}
+
+static gboolean
+read_hex4 (JsonScan *scan,
+           gunichar *c)
+{
+  guint i;
+
+  if (scan->end - scan->p < 4)
+    return FALSE;
+
+  *c = 0;
+  for (i = 0; i < 4; i++) {
+    if (!g_ascii_isxdigit (scan->p[i]))
+      return FALSE;
+    *c = *c * 16 + g_ascii_xdigit_value (scan->p[i]);
+  }
+  scan->p += 4;
+
+  return TRUE;
+}
+
+/* Read the string after the opening quote into the text */
+static gboolean
+read_string (JsonScan *scan)
+{
+  const char *start;
+  gunichar c, low;
+
+  g_string_truncate (scan->text, 0);
+
+  while (scan->p < scan->end) {
+    /* Copy the plain runs in one go */
+    for (start = scan->p;
+         scan->p < scan->end && *scan->p != '"' && *scan->p != '\\';
+         scan->p++)
+      ;
+    g_string_append_len (scan->text, start, scan->p - start);
+
+    if (scan->p == scan->end)
+      break;
+
+    /* The callers get the text as a C string, so it must be UTF-8 with no
+     * embedded NUL, which g_utf8_validate() rejects too */
+    if (*scan->p++ == '"')
+      return g_utf8_validate (scan->text->str, scan->text->len, NULL);
+
+    if (scan->p == scan->end)
+      break;
+
+    switch (*scan->p++) {
+    case '"': g_string_append_c (scan->text, '"'); break;
+    case '\\': g_string_append_c (scan->text, '\\'); break;
+    case '/': g_string_append_c (scan->text, '/'); break;
+    case 'b': g_string_append_c (scan->text, '\b'); break;
+    case 'f': g_string_append_c (scan->text, '\f'); break;
+    case 'n': g_string_append_c (scan->text, '\n'); break;
+    case 'r': g_string_append_c (scan->text, '\r'); break;
+    case 't': g_string_append_c (scan->text, '\t'); break;
+    case 'u':
+      if (!read_hex4 (scan, &c) || c == 0)
+        return FALSE;
+      /* A low surrogate only comes after a high one */
+      if (c >= 0xdc00 && c < 0xe000)
+        return FALSE;
+      /* Characters outside the BMP come as a surrogate pair */
+      if (c >= 0xd800 && c < 0xdc00) {
+        if (scan->end - scan->p < 6 ||
+            scan->p[0] != '\\' || scan->p[1] != 'u')
+          return FALSE;
+        scan->p += 2;
+        if (!read_hex4 (scan, &low) || low < 0xdc00 || low >= 0xe000)
+          return FALSE;
+        c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+      }
+      g_string_append_unichar (scan->text, c);
+      break;
+    default:
+      return FALSE;
+    }
+  }
+
+  return FALSE;
+}
+
+static gboolean
+read_literal (JsonScan   *scan,
+              const char *literal)
+{
+  gsize length = strlen (literal);
+
+  if ((gsize)(scan->end - scan->p) < length ||
+      strncmp (scan->p, literal, length) != 0)
+    return FALSE;
+
+  scan->p += length;
+  return TRUE;
+}
+
+JsonScanToken
+json_scan_next (JsonScan *scan)
+{
+  const char *start;
+
+  skip_space (scan);
+
+  /* Separators carry nothing the tokens don't already say */
+  if (scan->p < scan->end && *scan->p == ',') {
+    scan->p++;
+    skip_space (scan);
+  }
+
+  if (scan->p == scan->end)
+    return JSON_SCAN_END;
+
+  switch (*scan->p) {
+  case '{':
+    scan->p++;
+    return JSON_SCAN_BEGIN_OBJECT;
+  case '}':
+    scan->p++;
+    return JSON_SCAN_END_OBJECT;
+  case '[':
+    scan->p++;
+    return JSON_SCAN_BEGIN_ARRAY;
+  case ']':
+    scan->p++;
+    return JSON_SCAN_END_ARRAY;
+  case '"':
+    scan->p++;
+    if (!read_string (scan))
+      return JSON_SCAN_ERROR;
+    skip_space (scan);
+    if (scan->p < scan->end && *scan->p == ':') {
+      scan->p++;
+      return JSON_SCAN_KEY;
+    }
+    return JSON_SCAN_STRING;
+  case 't':
+    return read_literal (scan, "true") ? JSON_SCAN_TRUE : JSON_SCAN_ERROR;
+  case 'f':
+    return read_literal (scan, "false") ? JSON_SCAN_FALSE : JSON_SCAN_ERROR;
+  case 'n':
+    return read_literal (scan, "null") ? JSON_SCAN_NULL : JSON_SCAN_ERROR;
+  default:
+    break;
+  }
+
+  if (*scan->p != '-' && !g_ascii_isdigit (*scan->p))
+    return JSON_SCAN_ERROR;
+
+  for (start = scan->p++;
+       scan->p < scan->end &&
+       (g_ascii_isdigit (*scan->p) || *scan->p == '.' ||
+        *scan->p == 'e' || *scan->p == 'E' ||
+        *scan->p == '+' || *scan->p == '-');
+       scan->p++)
+    ;
+  g_string_truncate (scan->text, 0);
+  g_string_append_len (scan->text, start, scan->p - start);
+
+  return JSON_SCAN_NUMBER;
+}
+
+/* Skip to the end of the object or array the scan is in */
+gboolean
+json_scan_finish (JsonScan *scan)
+{
+  guint depth = 0;
+
+  for (;;) {
+    switch (json_scan_next (scan)) {
+    case JSON_SCAN_BEGIN_OBJECT:
+    case JSON_SCAN_BEGIN_ARRAY:
+      depth++;
+      break;
+    case JSON_SCAN_END_OBJECT:
+    case JSON_SCAN_END_ARRAY:
+      if (depth-- == 0)
+        return TRUE;
+      break;
+    case JSON_SCAN_ERROR:
+    case JSON_SCAN_END:
+      return FALSE;
+    default:
+      break;
+    }
+  }
+}
+
+/* Skip the rest of the value that @token, just returned, starts */
+gboolean
+json_scan_skip (JsonScan      *scan,
+                JsonScanToken  token)
+{
+  switch (token) {
+  case JSON_SCAN_BEGIN_OBJECT:
+  case JSON_SCAN_BEGIN_ARRAY:
+    return json_scan_finish (scan);
+  case JSON_SCAN_KEY:
+    return json_scan_skip (scan, json_scan_next (scan));
+  case JSON_SCAN_ERROR:
+  case JSON_SCAN_END:
+  case JSON_SCAN_END_OBJECT:
+  case JSON_SCAN_END_ARRAY:
+    return FALSE;
+  default:
+    return TRUE;
+  }
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#ifndef _JSON_SCAN_H_
+#define _JSON_SCAN_H_
+
+typedef enum {
+  JSON_SCAN_ERROR,
+  /* The data ran out */
+  JSON_SCAN_END,
+  JSON_SCAN_BEGIN_OBJECT,
+  JSON_SCAN_END_OBJECT,
+  JSON_SCAN_BEGIN_ARRAY,
+  JSON_SCAN_END_ARRAY,
+  /* A member name; the next token is its value */
+  JSON_SCAN_KEY,
+  JSON_SCAN_STRING,
+  JSON_SCAN_NUMBER,
+  JSON_SCAN_TRUE,
+  JSON_SCAN_FALSE,
+  JSON_SCAN_NULL
+} JsonScanToken;
+
+typedef struct {
+  const char *p;
+  const char *end;
+  /* The text of the last key, string or number */
+  GString *text;
+} JsonScan;
+
+void           json_scan_init   (JsonScan      *scan,
+                                 const char    *data,
+                                 gsize          length);
+void           json_scan_clear  (JsonScan      *scan);
+JsonScanToken  json_scan_next   (JsonScan      *scan);
+const char    *json_scan_text   (JsonScan      *scan);
+gboolean       json_scan_skip   (JsonScan      *scan,
+                                 JsonScanToken  token);
+gboolean       json_scan_finish (JsonScan      *scan);
+
+#endif /* _JSON_SCAN_H_ */
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <pango/pango.h>
+#include "markup.h"
+
+/*
+ * Checks strip_markup() against the pango_parse_markup() path it replaced.
+ * Every sample is valid Pango markup, so both must produce the same text,
+ * and each is stripped ITERATIONS times both ways to compare the cost.
+ * Exits non-zero if any sample differs.
+ */
+
+#define ITERATIONS 20000
+
+static const char *samples[] = {
+  "Just a plain status with nothing to strip",
+  "<b>Bold</b> and <i>italic</i> and <u>underlined</u>",
+  "Fish &amp; chips &lt;3 &gt; everything else",
+  "It&apos;s &quot;quoted&quot;",
+  "Caf&#233; at &#x263A; o&#39;clock",
+  "<span foreground=\"red\" weight=\"bold\">Red</span> alert",
+  "<span font_desc='Sans 12'>Nested <b>markup <i>here</i></b></span> done",
+  "\xe4\xbd\xa0\xe5\xa5\xbd <b>\xe4\xb8\x96\xe7\x95\x8c</b> &amp; more text after "
+  "the markup to make the status about as long as a real one tends to be",
+};
+
+static char *
+pango_strip (const char *text)
+{
+  char *stripped = NULL;
+
+  if (!pango_parse_markup (text, -1, 0, NULL, &stripped, NULL, NULL))
+    return NULL;
+
+  return stripped;
+}
+
+static gint64
+time_strip (char *(*strip) (const char *text))
+{
+  gint64 start;
+  guint i, j;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < ITERATIONS; i++)
+    for (j = 0; j < G_N_ELEMENTS (samples); j++)
+      g_free (strip (samples[j]));
+
+  return g_get_monotonic_time () - start;
+}
+
+int
+main (int argc, char **argv)
+{
+  char *ours, *theirs;
+  gint64 ours_time, theirs_time;
+  gboolean ok = TRUE;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (samples); i++) {
+    ours = strip_markup (samples[i]);
+    theirs = pango_strip (samples[i]);
+
+    if (g_strcmp0 (ours, theirs) != 0) {
+      printf ("MISMATCH %s\n  strip_markup: %s\n  pango: %s\n",
+              samples[i], ours, theirs ? theirs : "(rejected)");
+      ok = FALSE;
+    }
+
+    g_free (ours);
+    g_free (theirs);
+  }
+
+  ours_time = time_strip (strip_markup);
+  theirs_time = time_strip (pango_strip);
+
+  printf ("%u statuses: strip_markup %.1fms, pango %.1fms, %.1fx\n",
+          ITERATIONS * (guint)G_N_ELEMENTS (samples),
+          ours_time / 1000.0, theirs_time / 1000.0,
+          ours_time ? (double)theirs_time / ours_time : 0.0);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include "markup.h"
+
+/*
+ * Status text from some services is HTML rather than Pango markup, which
+ * pango_parse_markup() rejects outright.  This turns it into plain text in a
+ * single pass: tags are dropped, line breaks become newlines and character
+ * references are decoded.  No reference decodes to more bytes than it is
+ * written with, so the output is never longer than the input and is written
+ * into one buffer of that size.  Anything that doesn't parse is kept as-is.
+ */
+
+static const struct {
+  const char *name;
+  gsize length;
+  gunichar c;
+} entities[] = {
+  { "amp", 3, '&' },
+  { "lt", 2, '<' },
+  { "gt", 2, '>' },
+  { "quot", 4, '"' },
+  { "apos", 4, '\'' },
+  { "nbsp", 4, 0xa0 },
+};
+
+/* Longest reference worth looking for, "&#x10FFFF;" */
+#define MAX_ENTITY 10
+
+/* Decode the reference at @p, returning its length or 0 if there isn't one */
+static gsize
+decode_entity (const char *p,
+               gunichar   *c)
+{
+  const char *name, *end;
+  gunichar value = 0;
+  guint i;
+
+  name = p + 1;
+  for (end = name; *end && *end != ';'; end++)
+    if (end - p >= MAX_ENTITY)
+      return 0;
+
+  if (*end != ';' || end == name)
+    return 0;
+
+  if (*name != '#') {
+    for (i = 0; i < G_N_ELEMENTS (entities); i++) {
+      if ((gsize)(end - name) == entities[i].length &&
+          strncmp (name, entities[i].name, entities[i].length) == 0) {
+        *c = entities[i].c;
+        return end - p + 1;
+      }
+    }
+    return 0;
+  }
+
+  if (name[1] == 'x' || name[1] == 'X') {
+    if (end == name + 2)
+      return 0;
+    for (name += 2; name < end; name++) {
+      if (!g_ascii_isxdigit (*name))
+        return 0;
+      value = value * 16 + g_ascii_xdigit_value (*name);
+    }
+  } else {
+    if (end == name + 1)
+      return 0;
+    for (name += 1; name < end; name++) {
+      if (!g_ascii_isdigit (*name))
+        return 0;
+      value = value * 10 + g_ascii_digit_value (*name);
+    }
+  }
+
+  if (value == 0 || !g_unichar_validate (value))
+    return 0;
+
+  *c = value;
+  return end - p + 1;
+}
+
+/*
+ * Skip the tag at @p, returning its end or NULL if it isn't a tag.  @closed is
+ * cleared when the text runs out before the tag does, as no later tag can be
+ * closed either and there's no point scanning for them again.
+ */
+static const char *
+skip_tag (const char *p,
+          gboolean   *is_break,
+          gboolean   *closed)
+{
+  const char *q = p + 1;
+  char quote = 0;
+
+  if (!g_ascii_isalpha (*q) && *q != '/' && *q != '!')
+    return NULL;
+
+  *is_break = g_ascii_strncasecmp (q, "br", 2) == 0 &&
+    !g_ascii_isalnum (q[2]);
+
+  for (; *q; q++) {
+    if (quote) {
+      if (*q == quote)
+        quote = 0;
+    } else if (*q == '"' || *q == '\'') {
+      quote = *q;
+    } else if (*q == '>') {
+      return q + 1;
+    }
+  }
+
+  *closed = FALSE;
+  return NULL;
+}
+
+char *
+strip_markup (const char *text)
+{
+  const char *p, *next;
+  char *result, *out;
+  gboolean is_break, closed = TRUE;
+  gunichar c;
+  gsize len;
+
+  if (text == NULL)
+    return NULL;
+
+  result = out = g_malloc (strlen (text) + 1);
+
+  for (p = text; *p;) {
+    if (*p == '<' && closed &&
+        (next = skip_tag (p, &is_break, &closed)) != NULL) {
+      if (is_break)
+        *out++ = '\n';
+      p = next;
+    } else if (*p == '&' && (len = decode_entity (p, &c)) != 0) {
+      out += g_unichar_to_utf8 (c, out);
+      p += len;
+    } else {
+      *out++ = *p++;
+    }
+  }
+  *out = '\0';
+
+  return result;
+}
@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <rest/rest-proxy-call.h>
+#include "utils.h"
+#include "outbox.h"
+
+/*
+ * Messages are written to a key file under the user data directory as soon
+ * as they are queued, and only removed once the service has answered for
+ * them, so nothing is lost if the network or the credentials go away or the
+ * daemon exits.  While the outbox is ready up to OUTBOX_MAX_IN_FLIGHT calls
+ * are issued at once in queue order, so a burst of updates doesn't wait on
+ * one round trip each.  The answers are applied in queue order too: one that
+ * comes back early waits until those ahead of it have answered, so the
+ * service reports them and the file loses them in the order they were
+ * queued.  A failure that certainly didn't deliver the message leaves it
+ * queued and stops new calls until a backoff expires, after which sending
+ * starts again from the first message left.  One that might have delivered
+ * it is reported rather than risk posting it twice.  A rejected login holds
+ * the queue until the outbox is made ready again with new credentials.
+ */
+
+#define OUTBOX_GROUP "Outbox"
+#define OUTBOX_MAX_IN_FLIGHT 4
+#define OUTBOX_MIN_BACKOFF 5
+#define OUTBOX_MAX_BACKOFF (10 * 60)
+
+struct _Outbox {
+  char *filename;
+  GObject *owner;
+  OutboxCallFunc make_call;
+  OutboxSentFunc sent;
+  gpointer user_data;
+  GQueue *entries;
+  guint in_flight;
+  gboolean ready;
+  /* Being freed, so cancelled calls are left alone */
+  gboolean closing;
+  guint backoff;
+  guint retry_id;
+};
+
+typedef struct {
+  Outbox *outbox;
+  char *message;
+  /* The last attempt, kept with its outcome until it is its turn */
+  RestProxyCall *call;
+  gboolean answered;
+  GError *error;
+} OutboxEntry;
+
+static void outbox_flush (Outbox *outbox);
+
+static OutboxEntry *
+entry_new (Outbox     *outbox,
+           const char *message)
+{
+  OutboxEntry *entry;
+
+  entry = g_slice_new0 (OutboxEntry);
+  entry->outbox = outbox;
+  entry->message = g_strdup (message);
+
+  return entry;
+}
+
+/* Forget the last attempt so the message can be sent again */
+static void
+entry_reset (OutboxEntry *entry)
+{
+  if (entry->call) {
+    if (!entry->answered)
+      rest_proxy_call_cancel (entry->call);
+    g_object_unref (entry->call);
+    entry->call = NULL;
+  }
+
+  entry->answered = FALSE;
+  g_clear_error (&entry->error);
+}
+
+static void
+entry_free (OutboxEntry *entry)
+{
+  entry_reset (entry);
+
+  g_free (entry->message);
+  g_slice_free (OutboxEntry, entry);
+}
+
+static void
+outbox_load (Outbox *outbox)
+{
+  GKeyFile *keyfile;
+  char **messages;
+  gsize i, length = 0;
+
+  keyfile = g_key_file_new ();
+
+  if (g_key_file_load_from_file (keyfile, outbox->filename,
+                                 G_KEY_FILE_NONE, NULL)) {
+    messages = g_key_file_get_string_list (keyfile, OUTBOX_GROUP,
+                                           "Messages", &length, NULL);
+    for (i = 0; i < length; i++)
+      g_queue_push_tail (outbox->entries, entry_new (outbox, messages[i]));
+    g_strfreev (messages);
+  }
+
+  g_key_file_free (keyfile);
+}
+
+static void
+outbox_save (Outbox *outbox)
+{
+  GKeyFile *keyfile;
+  GError *error = NULL;
+  const char **messages;
+  char *dirname, *data;
+  gsize length;
+  GList *l;
+  guint i = 0;
+
+  if (g_queue_is_empty (outbox->entries)) {
+    g_unlink (outbox->filename);
+    return;
+  }
+
+  dirname = g_path_get_dirname (outbox->filename);
+  g_mkdir_with_parents (dirname, 0700);
+  g_free (dirname);
+
+  messages = g_new0 (const char *, g_queue_get_length (outbox->entries) + 1);
+  for (l = outbox->entries->head; l; l = l->next)
+    messages[i++] = ((OutboxEntry *)l->data)->message;
+
+  keyfile = g_key_file_new ();
+  g_key_file_set_string_list (keyfile, OUTBOX_GROUP, "Messages",
+                              messages, i);
+  data = g_key_file_to_data (keyfile, &length, NULL);
+
+  /* Drafts are as private as the account they are posted from */
+  if (!write_private_file (outbox->filename, data, length, &error)) {
+    g_message ("Error: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+  g_key_file_free (keyfile);
+  g_free (messages);
+}
+
+static gboolean
+retry_cb (gpointer user_data)
+{
+  Outbox *outbox = user_data;
+
+  outbox->retry_id = 0;
+  outbox_flush (outbox);
+
+  return FALSE;
+}
+
+static void
+schedule_retry (Outbox *outbox)
+{
+  if (outbox->retry_id)
+    return;
+
+  if (outbox->backoff)
+    outbox->backoff = MIN (outbox->backoff * 2, OUTBOX_MAX_BACKOFF);
+  else
+    outbox->backoff = OUTBOX_MIN_BACKOFF;
+
+  outbox->retry_id = g_timeout_add_seconds (outbox->backoff, retry_cb, outbox);
+}
+
+/*
+ * Hand the answers that have come back to the service in queue order,
+ * stopping at the first message still waiting for its own.
+ */
+static void
+outbox_settle (Outbox *outbox)
+{
+  OutboxEntry *entry;
+  gboolean changed = FALSE;
+  GList *l, *next;
+
+  for (l = outbox->entries->head; l; l = next) {
+    next = l->next;
+    entry = l->data;
+
+    /* Left over from a failure, to be sent again */
+    if (!entry->call)
+      continue;
+
+    if (!entry->answered)
+      break;
+
+    switch (outbox->sent (entry->message, entry->call, entry->error,
+                          outbox->user_data)) {
+    case OUTBOX_RETRY:
+      entry_reset (entry);
+      schedule_retry (outbox);
+      break;
+    case OUTBOX_HOLD:
+      entry_reset (entry);
+      outbox->ready = FALSE;
+      break;
+    case OUTBOX_SENT:
+      outbox->backoff = 0;
+      /* Fall through */
+    case OUTBOX_DROP:
+    case OUTBOX_UNKNOWN:
+      g_queue_delete_link (outbox->entries, l);
+      entry_free (entry);
+      changed = TRUE;
+      break;
+    }
+  }
+
+  if (changed)
+    outbox_save (outbox);
+
+  outbox_flush (outbox);
+}
+
+static void
+call_cb (RestProxyCall *call,
+         const GError  *error,
+         GObject       *weak_object,
+         gpointer       user_data)
+{
+  OutboxEntry *entry = user_data;
+  Outbox *outbox = entry->outbox;
+
+  /* outbox_free() is cancelling the call and releases it itself */
+  if (outbox->closing)
+    return;
+
+  /* The entry keeps the call until the answer is applied */
+  outbox->in_flight--;
+  entry->answered = TRUE;
+  if (error)
+    entry->error = g_error_copy (error);
+
+  outbox_settle (outbox);
+}
+
+static void
+outbox_flush (Outbox *outbox)
+{
+  OutboxEntry *entry;
+  GError *error = NULL;
+  GList *l;
+
+  /* After a failure nothing new is sent until the backoff expires */
+  if (!outbox->ready || outbox->retry_id)
+    return;
+
+  for (l = outbox->entries->head;
+       l && outbox->in_flight < OUTBOX_MAX_IN_FLIGHT;
+       l = l->next) {
+    entry = l->data;
+    if (entry->call)
+      continue;
+
+    entry->call = outbox->make_call (entry->message, outbox->user_data);
+    if (!entry->call) {
+      schedule_retry (outbox);
+      return;
+    }
+
+    if (!rest_proxy_call_async (entry->call, call_cb, outbox->owner,
+                                entry, &error)) {
+      g_message ("Error: %s", error->message);
+      g_clear_error (&error);
+      g_object_unref (entry->call);
+      entry->call = NULL;
+      schedule_retry (outbox);
+      return;
+    }
+
+    outbox->in_flight++;
+  }
+}
+
+Outbox *
+outbox_new (const char     *service,
+            GObject        *owner,
+            OutboxCallFunc  make_call,
+            OutboxSentFunc  sent,
+            gpointer        user_data)
+{
+  Outbox *outbox;
+
+  g_return_val_if_fail (service && make_call && sent, NULL);
+
+  outbox = g_slice_new0 (Outbox);
+  outbox->filename = g_build_filename (g_get_user_data_dir (),
+                                       "libsocialweb", "outbox", service,
+                                       NULL);
+  outbox->owner = owner;
+  outbox->make_call = make_call;
+  outbox->sent = sent;
+  outbox->user_data = user_data;
+  outbox->entries = g_queue_new ();
+
+  outbox_load (outbox);
+
+  return outbox;
+}
+
+void
+outbox_free (Outbox *outbox)
+{
+  OutboxEntry *entry;
+
+  if (!outbox)
+    return;
+
+  if (outbox->retry_id)
+    g_source_remove (outbox->retry_id);
+
+  /*
+   * The file isn't touched, so the messages are still there for the next
+   * run.  A message whose call is cancelled here may have been delivered
+   * already and will go out again then.
+   */
+  outbox->closing = TRUE;
+  while ((entry = g_queue_pop_head (outbox->entries)))
+    entry_free (entry);
+  g_queue_free (outbox->entries);
+
+  g_free (outbox->filename);
+  g_slice_free (Outbox, outbox);
+}
+
+void
+outbox_push (Outbox     *outbox,
+             const char *message)
+{
+  g_return_if_fail (outbox && message);
+
+  g_queue_push_tail (outbox->entries, entry_new (outbox, message));
+  outbox_save (outbox);
+  outbox_flush (outbox);
+}
+
+void
+outbox_set_ready (Outbox   *outbox,
+                  gboolean  ready)
+{
+  g_return_if_fail (outbox);
+
+  if (outbox->ready == ready)
+    return;
+
+  outbox->ready = ready;
+
+  /* Fresh credentials are worth trying straight away */
+  if (ready) {
+    if (outbox->retry_id) {
+      g_source_remove (outbox->retry_id);
+      outbox->retry_id = 0;
+    }
+    outbox->backoff = 0;
+    outbox_flush (outbox);
+  }
+}
+
+gboolean
+outbox_is_empty (Outbox *outbox)
+{
+  g_return_val_if_fail (outbox, TRUE);
+
+  return g_queue_is_empty (outbox->entries);
+}
+
+OutboxResult
+outbox_classify (RestProxyCall *call,
+                 const GError  *error)
+{
+  guint status;
+
+  if (!error)
+    return OUTBOX_SENT;
+
+  status = rest_proxy_call_get_status_code (call);
+
+  /*
+   * Failing to resolve or connect to the host, a request timeout, throttling
+   * and an unavailable server all mean the message wasn't acted on and can
+   * be sent again.  A login that was rejected won't be accepted until the
+   * credentials change.  Other transport errors and server errors may come
+   * after the message was posted, so resending it could post it twice.
+   */
+  if ((status >= 2 && status <= 5) || status == 408 || status == 429 ||
+      status == 503)
+    return OUTBOX_RETRY;
+
+  if (status == 401)
+    return OUTBOX_HOLD;
+
+  if (status < 100 || status >= 500)
+    return OUTBOX_UNKNOWN;
+
+  return OUTBOX_DROP;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib-object.h>
+#include <rest/rest-proxy-call.h>
+
+#ifndef _OUTBOX_H_
+#define _OUTBOX_H_
+
+typedef struct _Outbox Outbox;
+
+typedef enum {
+  OUTBOX_SENT,
+  /* Not delivered, and safe to send again after a backoff */
+  OUTBOX_RETRY,
+  /* Never going to be accepted */
+  OUTBOX_DROP,
+  /* May or may not have reached the service, so not sent again */
+  OUTBOX_UNKNOWN,
+  /* Kept, but nothing is sent until the outbox is made ready again */
+  OUTBOX_HOLD
+} OutboxResult;
+
+/* Build the call that delivers @message, or return NULL to try again later */
+typedef RestProxyCall *(*OutboxCallFunc) (const char *message,
+                                          gpointer    user_data);
+
+/* Called after every attempt; the return value decides what happens next */
+typedef OutboxResult (*OutboxSentFunc) (const char    *message,
+                                        RestProxyCall *call,
+                                        const GError  *error,
+                                        gpointer       user_data);
+
+Outbox      *outbox_new       (const char     *service,
+                               GObject        *owner,
+                               OutboxCallFunc  make_call,
+                               OutboxSentFunc  sent,
+                               gpointer        user_data);
+void         outbox_free      (Outbox         *outbox);
+void         outbox_push      (Outbox         *outbox,
+                               const char     *message);
+void         outbox_set_ready (Outbox         *outbox,
+                               gboolean        ready);
+gboolean     outbox_is_empty  (Outbox         *outbox);
+OutboxResult outbox_classify  (RestProxyCall  *call,
+                               const GError   *error);
+
+#endif /* _OUTBOX_H_ */
@@ -0,0 +1,1069 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libsocialweb/sw-utils.h>
+#include <libsocialweb/sw-debug.h>
+#include <libsocialweb/sw-item.h>
+
+#include "utils.h"
+#include "trace.h"
+#include "cache-stamp.h"
+#include "item-cache.h"
+#include "circuit-breaker.h"
+#include "rate-governor.h"
+#include "poll-item-view.h"
+
+/*
+ * The views of every service poll the same way: serve the cache, fetch the
+ * pages of the query one after another on a timer and whenever the
+ * credentials become valid, publish each page as it arrives and save the
+ * lot once the last one is in.  A view no client has called on for a while
+ * stops until the next call.  That lives here once; a service subclass
+ * describes its calls with a PollItemViewInfo and turns responses into
+ * items in parse_page.
+ */
+
+G_DEFINE_TYPE (SwPollItemView, sw_poll_item_view, SW_TYPE_ITEM_VIEW)
+
+#define GET_PRIVATE(o) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((o), SW_TYPE_POLL_ITEM_VIEW, SwPollItemViewPrivate))
+
+typedef struct _SwPollItemViewPrivate SwPollItemViewPrivate;
+
+struct _SwPollItemViewPrivate {
+  RestProxy *proxy;
+  guint timeout_id;
+  GHashTable *params;
+  gchar *query;
+  guint page_size;
+  guint n_pages;
+  /* The pages of the current fetch, and which fetch that is */
+  SwSet *pages;
+  guint page;
+  guint step;
+  guint generation;
+  /* How many entries the first call of the page held */
+  guint length;
+  char *cursor;
+  /* The trace of the page being parsed, for sw_poll_item_view_mark_parsed() */
+  RequestTrace *parse_trace;
+  /* The call in flight, if any; only one is ever outstanding */
+  RestProxyCall *call;
+  guint refresh_id;
+  /*
+   * Whether the credentials were valid the last time the caps settled, and
+   * as last reported while they are settling
+   */
+  gboolean credentials_valid;
+  gboolean caps_valid;
+  guint caps_id;
+  /*
+   * Between start and stop, as last told to polling_changed, unless the view
+   * is dormant.  A view whose client leaves the bus is released by the client
+   * monitor and stops polling when it is disposed.
+   */
+  gboolean polling;
+  /*
+   * Started, but no client has called on it for IDLE_TIMEOUT, so it has no
+   * timer and no call in flight until it is next started or refreshed
+   */
+  gboolean dormant;
+  guint idle_id;
+};
+
+enum
+{
+  PROP_0,
+  PROP_PROXY,
+  PROP_PARAMS,
+  PROP_QUERY
+};
+
+#define UPDATE_TIMEOUT 5 * 60
+
+/* Refreshes asked for within this many milliseconds make one fetch */
+#define REFRESH_DELAY 500
+
+/* A started view nobody calls on for this many seconds goes dormant */
+#define IDLE_TIMEOUT 60 * 60
+
+#define GET_INFO(o) (SW_POLL_ITEM_VIEW_GET_CLASS (o)->info)
+
+static void _service_item_hidden_cb (SwService   *service,
+                                     const gchar *uid,
+                                     SwItemView  *item_view);
+static void _service_user_changed_cb (SwService  *service,
+                                      SwItemView *item_view);
+static void _service_capabilities_changed_cb (SwService    *service,
+                                              const gchar **caps,
+                                              SwItemView   *item_view);
+
+static void
+sw_poll_item_view_get_property (GObject    *object,
+                                guint       property_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (object);
+
+  switch (property_id) {
+    case PROP_PROXY:
+      g_value_set_object (value, priv->proxy);
+      break;
+    case PROP_PARAMS:
+      g_value_set_boxed (value, priv->params);
+      break;
+    case PROP_QUERY:
+      g_value_set_string (value, priv->query);
+      break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+sw_poll_item_view_set_property (GObject      *object,
+                                guint         property_id,
+                                const GValue *value,
+                                GParamSpec   *pspec)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (object);
+
+  switch (property_id) {
+    case PROP_PROXY:
+      if (priv->proxy)
+      {
+        g_object_unref (priv->proxy);
+      }
+      priv->proxy = g_value_dup_object (value);
+      break;
+    case PROP_PARAMS:
+      priv->params = g_value_dup_boxed (value);
+      break;
+    case PROP_QUERY:
+      priv->query = g_value_dup_string (value);
+      break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+/*
+ * The trace of a fetch is attached to whichever of its calls is in flight,
+ * so a call only ever marks the fetch it belongs to.
+ */
+#define TRACE_KEY "sw-poll-trace"
+
+static void
+_trace_dropped (gpointer data)
+{
+  request_trace_abort (data, "call dropped");
+}
+
+/* Drop the fetch in progress, if there is one */
+static void
+_cancel_fetch (SwPollItemView *view,
+               const char     *reason)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  if (priv->refresh_id) {
+    g_source_remove (priv->refresh_id);
+    priv->refresh_id = 0;
+  }
+
+  if (priv->call) {
+    request_trace_abort (g_object_steal_data (G_OBJECT (priv->call),
+                                              TRACE_KEY),
+                         reason);
+
+    /* Anything still on its way back is stale now */
+    priv->generation++;
+    rest_proxy_call_cancel (priv->call);
+    priv->call = NULL;
+  }
+}
+
+static void
+_set_polling (SwPollItemView *view,
+              gboolean        polling)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (view);
+
+  if (priv->polling == polling)
+    return;
+
+  priv->polling = polling;
+
+  /* Only views that poll share the budget for periodic fetches */
+  if (polling)
+    rate_governor_add_view (priv->proxy);
+  else
+    rate_governor_remove_view (priv->proxy);
+
+  if (klass->polling_changed)
+    klass->polling_changed (view, polling);
+}
+
+static void
+sw_poll_item_view_dispose (GObject *object)
+{
+  SwItemView *item_view = SW_ITEM_VIEW (object);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (object);
+
+  _set_polling (SW_POLL_ITEM_VIEW (object), FALSE);
+  _cancel_fetch (SW_POLL_ITEM_VIEW (object), "view disposed");
+
+  if (priv->proxy)
+  {
+    g_object_unref (priv->proxy);
+    priv->proxy = NULL;
+  }
+
+  if (priv->timeout_id)
+  {
+    g_source_remove (priv->timeout_id);
+    priv->timeout_id = 0;
+  }
+
+  if (priv->caps_id) {
+    g_source_remove (priv->caps_id);
+    priv->caps_id = 0;
+  }
+
+  if (priv->idle_id) {
+    g_source_remove (priv->idle_id);
+    priv->idle_id = 0;
+  }
+
+  if (priv->pages) {
+    sw_set_unref (priv->pages);
+    priv->pages = NULL;
+  }
+
+  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
+                                        _service_item_hidden_cb,
+                                        item_view);
+  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
+                                        _service_user_changed_cb,
+                                        item_view);
+  g_signal_handlers_disconnect_by_func (sw_item_view_get_service (item_view),
+                                        _service_capabilities_changed_cb,
+                                        item_view);
+
+  G_OBJECT_CLASS (sw_poll_item_view_parent_class)->dispose (object);
+}
+
+static void
+sw_poll_item_view_finalize (GObject *object)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (object);
+
+  g_free (priv->query);
+  g_free (priv->cursor);
+  g_hash_table_unref (priv->params);
+
+  G_OBJECT_CLASS (sw_poll_item_view_parent_class)->finalize (object);
+}
+
+static const char *
+_get_endpoint (SwPollItemView *view,
+               guint           page,
+               guint           step)
+{
+  return step == 0 ? GET_INFO (view)->endpoint : NULL;
+}
+
+/* The call that decides whether the view can be fetched at all */
+static const char *
+_get_main_endpoint (SwPollItemView *view)
+{
+  return SW_POLL_ITEM_VIEW_GET_CLASS (view)->get_endpoint (view, 0, 0);
+}
+
+/* How many calls fetching @page takes */
+static guint
+_count_calls (SwPollItemView *view,
+              guint           page)
+{
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (view);
+  guint n = 0;
+
+  while (klass->get_endpoint (view, page, n))
+    n++;
+
+  return n;
+}
+
+static gboolean _get_step (SwPollItemView *view,
+                           RequestTrace   *trace);
+
+static void
+_fetch_done (SwPollItemView *view,
+             RequestTrace   *trace)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (view);
+  SwService *service;
+
+  if (klass->fetch_finished)
+    klass->fetch_finished (view);
+
+  service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+
+  /* Save the results of this set to the cache */
+  item_cache_save (service,
+                   priv->query,
+                   priv->params,
+                   priv->pages);
+  cache_stamp_touch (sw_service_get_name (service),
+                     priv->query,
+                     priv->params);
+
+  request_trace_mark (trace, TRACE_STAGE_CACHE);
+  request_trace_finish (trace);
+}
+
+/*
+ * Publish what has been fetched so far, then either ask for the next older
+ * page or, once the last one is in, save the lot to the cache.
+ */
+static void
+_page_done (SwPollItemView *view,
+            RequestTrace   *trace)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  gboolean more;
+
+  sw_item_view_set_from_set (SW_ITEM_VIEW (view), priv->pages);
+  request_trace_mark (trace, TRACE_STAGE_PUBLISH);
+
+  /* Stream the older pages in one at a time, each published as it arrives */
+  more = ++priv->page < priv->n_pages && priv->length == priv->page_size;
+  if (GET_INFO (view)->paging == POLL_PAGING_CURSOR)
+    more = more && priv->cursor != NULL;
+
+  priv->step = 0;
+
+  if (more &&
+      rate_governor_acquire (priv->proxy, RATE_PRIORITY_POLL,
+                             _count_calls (view, priv->page)) &&
+      _get_step (view, trace))
+    return;
+
+  _fetch_done (view, trace);
+}
+
+static void
+_got_page_cb (RestProxyCall *call,
+              const GError  *error,
+              GObject       *weak_object,
+              gpointer       userdata)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (weak_object);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (view);
+  RequestTrace *trace;
+  const char *endpoint;
+  gint length;
+
+  /* Whatever happens next, the fetch now owns its trace again */
+  trace = g_object_steal_data (G_OBJECT (call), TRACE_KEY);
+  request_trace_mark (trace, TRACE_STAGE_RESPONSE);
+
+  /* The fetch this page was asked for has been cancelled */
+  if (GPOINTER_TO_UINT (userdata) != priv->generation) {
+    request_trace_abort (trace, "superseded");
+    g_object_unref (call);
+    return;
+  }
+
+  priv->call = NULL;
+  endpoint = klass->get_endpoint (view, priv->page, priv->step);
+
+  rate_governor_update (priv->proxy, call);
+  circuit_breaker_record (priv->proxy, endpoint, call, error);
+
+  if (error) {
+    g_message ("Error: %s", error->message);
+    if (klass->call_failed)
+      klass->call_failed (view, call, error);
+    request_trace_abort (trace, error->message);
+    g_object_unref (call);
+    return;
+  }
+
+  priv->parse_trace = trace;
+  length = klass->parse_page (view, call, endpoint);
+  priv->parse_trace = NULL;
+  g_object_unref (call);
+
+  if (length < 0) {
+    request_trace_abort (trace, "invalid payload");
+    return;
+  }
+
+  request_trace_mark (trace, TRACE_STAGE_ITEMS);
+
+  if (priv->step == 0)
+    priv->length = length;
+
+  /* Some pages take more than one call */
+  priv->step++;
+  if (klass->get_endpoint (view, priv->page, priv->step) &&
+      _get_step (view, trace))
+    return;
+
+  _page_done (view, trace);
+}
+
+static void
+_add_page_params (SwPollItemView *view,
+                  RestProxyCall  *call)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  const PollItemViewInfo *info = GET_INFO (view);
+  char *count, *page = NULL;
+
+  count = g_strdup_printf ("%u", priv->page_size);
+  rest_proxy_call_add_param (call, info->count_param, count);
+  g_free (count);
+
+  switch (info->paging) {
+    case POLL_PAGING_NUMBER:
+      page = g_strdup_printf ("%u", priv->page + info->first_page);
+      break;
+    case POLL_PAGING_INDEX:
+      page = g_strdup_printf ("%u",
+                              priv->page * priv->page_size + info->first_page);
+      break;
+    case POLL_PAGING_CURSOR:
+      page = g_strdup (priv->cursor);
+      break;
+  }
+
+  if (page)
+    rest_proxy_call_add_param (call, info->page_param, page);
+  g_free (page);
+}
+
+/* Ask for the current step of the current page, handing @trace to the call */
+static gboolean
+_get_step (SwPollItemView *view,
+           RequestTrace   *trace)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (view);
+  RestProxyCall *call;
+  const char *endpoint;
+
+  endpoint = klass->get_endpoint (view, priv->page, priv->step);
+
+  call = rest_proxy_new_call (priv->proxy);
+  rest_proxy_call_set_function (call, endpoint);
+  _add_page_params (view, call);
+
+  if (klass->prepare_call && !klass->prepare_call (view, call, endpoint)) {
+    g_object_unref (call);
+    return FALSE;
+  }
+
+  if (priv->page == 0 && priv->step == 0)
+    request_trace_mark (trace, TRACE_STAGE_REQUEST);
+  if (trace)
+    g_object_set_data_full (G_OBJECT (call), TRACE_KEY,
+                            trace, _trace_dropped);
+
+  rest_proxy_call_async (call, _got_page_cb, (GObject *)view,
+                         GUINT_TO_POINTER (priv->generation), NULL);
+  priv->call = call;
+
+  return TRUE;
+}
+
+static void
+_get_status_updates (SwPollItemView *view,
+                     RatePriority    priority)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (view);
+  RequestTrace *trace;
+
+  /* The fetch already under way will do */
+  if (priv->call) {
+    g_debug ("Fetch of %s already in flight", priv->query);
+    return;
+  }
+
+  /* Only a periodic poll may be answered from elsewhere, a request wants
+   * what the service has now */
+  if (priority == RATE_PRIORITY_POLL &&
+      klass->fetch_local && klass->fetch_local (view)) {
+    g_debug ("Fetch of %s served locally", priv->query);
+    return;
+  }
+
+  if (!circuit_breaker_allow (priv->proxy, _get_main_endpoint (view)) ||
+      !rate_governor_acquire (priv->proxy, priority, _count_calls (view, 0)))
+    return;
+
+  trace = request_trace_begin (GET_INFO (view)->name, priv->query);
+
+  if (priv->pages)
+    sw_set_unref (priv->pages);
+  priv->pages = sw_item_set_new ();
+  priv->page = 0;
+  priv->step = 0;
+  priv->generation++;
+  g_free (priv->cursor);
+  priv->cursor = NULL;
+
+  if (!_get_step (view, trace))
+    request_trace_abort (trace, "call not possible");
+}
+
+static gboolean
+_update_timeout_cb (gpointer data)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (data);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (view);
+
+  if (klass->is_pushed && klass->is_pushed (view))
+    return TRUE;
+
+  _get_status_updates (view, RATE_PRIORITY_POLL);
+
+  return TRUE;
+}
+
+static gboolean
+_load_from_cache (SwPollItemView *view)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwSet *set;
+
+  set = item_cache_load (sw_item_view_get_service (SW_ITEM_VIEW (view)),
+                         priv->query,
+                         priv->params);
+
+  if (set)
+  {
+    sw_item_view_set_from_set (SW_ITEM_VIEW (view),
+                               set);
+    /* Kept so pushed items are cached along with what was loaded */
+    if (priv->pages)
+      sw_set_unref (priv->pages);
+    priv->pages = set;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Start polling, from the cache where it is fresh enough */
+static void
+_start_polling (SwPollItemView *view)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwService *service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+  gboolean loaded = FALSE;
+  gint64 age;
+
+  priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
+                                            (GSourceFunc)_update_timeout_cb,
+                                            view);
+  age = cache_stamp_get_age (sw_service_get_name (service),
+                             priv->query,
+                             priv->params);
+
+  /*
+   * Serve whatever is cached unless it is known to be too old, and only go
+   * to the network if it isn't fresh.  Stale items stay visible until the
+   * fetch replaces them, and while the endpoint is failing old items are
+   * better than none.
+   */
+  if (age < CACHE_STAMP_MAX_AGE ||
+      circuit_breaker_is_open (priv->proxy, _get_main_endpoint (view)))
+    loaded = _load_from_cache (view);
+
+  if (!loaded || age < 0 || age >= UPDATE_TIMEOUT)
+    _get_status_updates (view, RATE_PRIORITY_REQUEST);
+
+  _set_polling (view, TRUE);
+}
+
+/*
+ * A client that keeps the view but no longer calls on it, such as a hidden
+ * panel, shouldn't keep the daemon fetching for nobody: drop the timer and
+ * whatever is in flight until the view is next started or refreshed.
+ */
+static gboolean
+_idle_cb (gpointer data)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (data);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  g_debug ("Suspending idle %s view", priv->query);
+
+  priv->idle_id = 0;
+  priv->dormant = TRUE;
+
+  if (priv->timeout_id)
+  {
+    g_source_remove (priv->timeout_id);
+    priv->timeout_id = 0;
+  }
+
+  _set_polling (view, FALSE);
+  _cancel_fetch (view, "view idle");
+
+  return FALSE;
+}
+
+/* A client called on the view, so it isn't idle for a while yet */
+static void
+_touch (SwPollItemView *view)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  if (priv->idle_id)
+    g_source_remove (priv->idle_id);
+  priv->idle_id = g_timeout_add_seconds (IDLE_TIMEOUT, _idle_cb, view);
+}
+
+/* Pick up where a dormant view left off, serving the cache first */
+static void
+_wake (SwPollItemView *view)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  g_debug ("Resuming idle %s view", priv->query);
+
+  priv->dormant = FALSE;
+  _start_polling (view);
+}
+
+static void
+poll_item_view_start (SwItemView *item_view)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (item_view);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (item_view);
+
+  if (priv->polling)
+  {
+    g_warning (G_STRLOC ": View already started.");
+  } else if (priv->dormant) {
+    _wake (view);
+  } else {
+    _start_polling (view);
+  }
+
+  _touch (view);
+}
+
+static void
+poll_item_view_stop (SwItemView *item_view)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (item_view);
+
+  if (!priv->polling && !priv->dormant)
+  {
+    g_warning (G_STRLOC ": View not running");
+  } else if (priv->timeout_id) {
+    g_source_remove (priv->timeout_id);
+    priv->timeout_id = 0;
+  }
+
+  if (priv->idle_id)
+  {
+    g_source_remove (priv->idle_id);
+    priv->idle_id = 0;
+  }
+  priv->dormant = FALSE;
+
+  _set_polling (SW_POLL_ITEM_VIEW (item_view), FALSE);
+  _cancel_fetch (SW_POLL_ITEM_VIEW (item_view), "view stopped");
+}
+
+static gboolean
+_refresh_cb (gpointer data)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (data);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  priv->refresh_id = 0;
+  _get_status_updates (view, RATE_PRIORITY_REQUEST);
+
+  return FALSE;
+}
+
+/* A burst of refreshes is folded into a single fetch */
+static void
+_schedule_refresh (SwPollItemView *view)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  if (!priv->refresh_id)
+    priv->refresh_id = g_timeout_add (REFRESH_DELAY, _refresh_cb, view);
+}
+
+static void
+poll_item_view_refresh (SwItemView *item_view)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (item_view);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (item_view);
+
+  /* Only a started view can go idle */
+  if (priv->polling || priv->dormant)
+    _touch (view);
+
+  if (priv->dormant)
+    _wake (view);
+  else
+    _schedule_refresh (view);
+}
+
+static void
+_service_item_hidden_cb (SwService   *service,
+                         const gchar *uid,
+                         SwItemView  *item_view)
+{
+  sw_item_view_remove_by_uid (item_view, uid);
+}
+
+static void
+_service_user_changed_cb (SwService  *service,
+                          SwItemView *item_view)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (item_view);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  SwPollItemViewClass *klass = SW_POLL_ITEM_VIEW_GET_CLASS (item_view);
+  SwSet *set;
+
+  /* A fetch for the old user would only cache its timeline again */
+  _cancel_fetch (view, "user changed");
+  if (priv->pages) {
+    sw_set_unref (priv->pages);
+    priv->pages = NULL;
+  }
+
+  if (klass->user_changed)
+    klass->user_changed (view);
+
+  /* We need to empty the set */
+  set = sw_item_set_new ();
+  sw_item_view_set_from_set (SW_ITEM_VIEW (item_view),
+                             set);
+  sw_set_unref (set);
+
+  /* And drop the cache */
+  item_cache_drop_all (service);
+  cache_stamp_drop_all (sw_service_get_name (service));
+
+  if (priv->polling)
+    _schedule_refresh (view);
+}
+
+/*
+ * A single credentials update can change the caps several times over, going
+ * offline and back online on the way, so only act once they have settled and
+ * then only on an actual change.
+ */
+static gboolean
+_caps_settled_cb (gpointer data)
+{
+  SwPollItemView *view = SW_POLL_ITEM_VIEW (data);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  priv->caps_id = 0;
+
+  if (priv->caps_valid == priv->credentials_valid)
+    return FALSE;
+
+  priv->credentials_valid = priv->caps_valid;
+
+  /*
+   * The caps only arm the timer of a running view; one that isn't polling,
+   * dormant views included, picks the credentials up when it is started
+   */
+  if (!priv->polling)
+    return FALSE;
+
+  if (priv->credentials_valid)
+  {
+    _get_status_updates (view, RATE_PRIORITY_REQUEST);
+
+    if (!priv->timeout_id)
+    {
+      priv->timeout_id = g_timeout_add_seconds (UPDATE_TIMEOUT,
+                                                (GSourceFunc)_update_timeout_cb,
+                                                view);
+    }
+  } else {
+    if (priv->timeout_id)
+    {
+      g_source_remove (priv->timeout_id);
+      priv->timeout_id = 0;
+    }
+
+    /* Whatever is pending would only be turned away */
+    _cancel_fetch (view, "credentials lost");
+  }
+
+  return FALSE;
+}
+
+static void
+_service_capabilities_changed_cb (SwService    *service,
+                                  const gchar **caps,
+                                  SwItemView   *item_view)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (item_view);
+
+  priv->caps_valid = sw_service_has_cap (caps, CREDENTIALS_VALID);
+
+  if (!priv->caps_id)
+    priv->caps_id = g_idle_add (_caps_settled_cb, item_view);
+}
+
+static void
+sw_poll_item_view_constructed (GObject *object)
+{
+  SwItemView *item_view = SW_ITEM_VIEW (object);
+  SwPollItemViewPrivate *priv = GET_PRIVATE (object);
+  const PollItemViewInfo *info = GET_INFO (object);
+  SwService *service = sw_item_view_get_service (item_view);
+
+  priv->page_size = get_uint_param (priv->params, "count",
+                                    info->default_page_size,
+                                    info->max_page_size);
+  priv->n_pages = get_uint_param (priv->params, "pages", 1, info->max_pages);
+
+  /* Only a change from here on needs a refresh */
+  priv->credentials_valid = sw_service_has_cap
+    (SW_SERVICE_GET_CLASS (service)->get_dynamic_caps (service),
+     CREDENTIALS_VALID);
+  priv->caps_valid = priv->credentials_valid;
+
+  g_signal_connect (sw_item_view_get_service (item_view),
+                    "item-hidden",
+                    (GCallback)_service_item_hidden_cb,
+                    item_view);
+
+  g_signal_connect (sw_item_view_get_service (item_view),
+                    "user-changed",
+                    (GCallback)_service_user_changed_cb,
+                    item_view);
+
+  g_signal_connect (sw_item_view_get_service (item_view),
+                    "capabilities-changed",
+                    (GCallback)_service_capabilities_changed_cb,
+                    item_view);
+
+  if (G_OBJECT_CLASS (sw_poll_item_view_parent_class)->constructed)
+    G_OBJECT_CLASS (sw_poll_item_view_parent_class)->constructed (object);
+}
+
+static void
+sw_poll_item_view_class_init (SwPollItemViewClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  SwItemViewClass *item_view_class = SW_ITEM_VIEW_CLASS (klass);
+  GParamSpec *pspec;
+
+  g_type_class_add_private (klass, sizeof (SwPollItemViewPrivate));
+
+  object_class->get_property = sw_poll_item_view_get_property;
+  object_class->set_property = sw_poll_item_view_set_property;
+  object_class->dispose = sw_poll_item_view_dispose;
+  object_class->finalize = sw_poll_item_view_finalize;
+  object_class->constructed = sw_poll_item_view_constructed;
+
+  item_view_class->start = poll_item_view_start;
+  item_view_class->stop = poll_item_view_stop;
+  item_view_class->refresh = poll_item_view_refresh;
+
+  klass->get_endpoint = _get_endpoint;
+
+  pspec = g_param_spec_object ("proxy",
+                               "proxy",
+                               "proxy",
+                               REST_TYPE_PROXY,
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+  g_object_class_install_property (object_class, PROP_PROXY, pspec);
+
+  pspec = g_param_spec_string ("query",
+                               "query",
+                               "query",
+                               NULL,
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+  g_object_class_install_property (object_class, PROP_QUERY, pspec);
+
+  pspec = g_param_spec_boxed ("params",
+                              "params",
+                              "params",
+                              G_TYPE_HASH_TABLE,
+                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+  g_object_class_install_property (object_class, PROP_PARAMS, pspec);
+}
+
+static void
+sw_poll_item_view_init (SwPollItemView *self)
+{
+}
+
+RestProxy *
+sw_poll_item_view_get_proxy (SwPollItemView *view)
+{
+  return GET_PRIVATE (view)->proxy;
+}
+
+const char *
+sw_poll_item_view_get_query (SwPollItemView *view)
+{
+  return GET_PRIVATE (view)->query;
+}
+
+/* The page being fetched, counting from 0 */
+guint
+sw_poll_item_view_get_page (SwPollItemView *view)
+{
+  return GET_PRIVATE (view)->page;
+}
+
+/* How many entries a page asks for */
+guint
+sw_poll_item_view_get_page_size (SwPollItemView *view)
+{
+  return GET_PRIVATE (view)->page_size;
+}
+
+/* How many pages a fetch asks for at most */
+guint
+sw_poll_item_view_get_n_pages (SwPollItemView *view)
+{
+  return GET_PRIVATE (view)->n_pages;
+}
+
+/* Bumped at the start of every fetch */
+guint
+sw_poll_item_view_get_generation (SwPollItemView *view)
+{
+  return GET_PRIVATE (view)->generation;
+}
+
+/*
+ * Whether the entry that would become the item @prefix@id has been hidden.
+ * parse_page asks this with the raw id before building anything, so hidden
+ * entries cost neither an item nor image fetches.
+ */
+gboolean
+sw_poll_item_view_is_banned (SwPollItemView *view,
+                             const char     *prefix,
+                             const char     *id)
+{
+  SwService *service = sw_item_view_get_service (SW_ITEM_VIEW (view));
+  char buf[128], *uid;
+  gboolean banned;
+
+  if (id == NULL)
+    return FALSE;
+
+  if (g_snprintf (buf, sizeof (buf), "%s%s", prefix, id) < sizeof (buf))
+    return sw_service_is_uid_banned (service, buf);
+
+  uid = g_strconcat (prefix, id, NULL);
+  banned = sw_service_is_uid_banned (service, uid);
+  g_free (uid);
+
+  return banned;
+}
+
+/* Add @item to the fetch, taking the reference */
+void
+sw_poll_item_view_add_item (SwPollItemView *view,
+                            SwItem         *item)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  sw_set_add (priv->pages, (GObject *)item);
+  g_object_unref (item);
+}
+
+/*
+ * Called by parse_page once the payload is decoded and before any item is
+ * built, so the trace tells decoding and building apart
+ */
+void
+sw_poll_item_view_mark_parsed (SwPollItemView *view)
+{
+  request_trace_mark (GET_PRIVATE (view)->parse_trace, TRACE_STAGE_PARSE);
+}
+
+/* Where the next page starts, for POLL_PAGING_CURSOR; NULL if there's none */
+void
+sw_poll_item_view_set_cursor (SwPollItemView *view,
+                              const char     *cursor)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+
+  g_free (priv->cursor);
+  priv->cursor = g_strdup (cursor);
+}
+
+/*
+ * Publish @items that arrived other than by fetching, and keep them in the
+ * cache with the rest.  A fetch under way saves them when it is done.
+ */
+void
+sw_poll_item_view_push_items (SwPollItemView *view,
+                              GList          *items)
+{
+  SwPollItemViewPrivate *priv = GET_PRIVATE (view);
+  GList *l;
+
+  sw_item_view_add_items (SW_ITEM_VIEW (view), items);
+
+  if (priv->pages == NULL)
+    priv->pages = sw_item_set_new ();
+  for (l = items; l; l = l->next)
+    sw_set_add (priv->pages, l->data);
+
+  if (priv->call)
+    return;
+
+  item_cache_save (sw_item_view_get_service (SW_ITEM_VIEW (view)),
+                   priv->query,
+                   priv->params,
+                   priv->pages);
+}
+
+/*
+ * Fetch shortly, as a refresh would, for a subclass that knows it has missed
+ * something.  Ignored unless the view is polling.
+ */
+void
+sw_poll_item_view_fetch_soon (SwPollItemView *view)
+{
+  if (GET_PRIVATE (view)->polling)
+    _schedule_refresh (view);
+}
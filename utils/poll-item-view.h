@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SW_POLL_ITEM_VIEW
+#define _SW_POLL_ITEM_VIEW
+
+#include <glib-object.h>
+#include <rest/rest-proxy.h>
+#include <rest/rest-proxy-call.h>
+#include <libsocialweb/sw-item.h>
+#include <libsocialweb/sw-item-view.h>
+
+G_BEGIN_DECLS
+
+#define SW_TYPE_POLL_ITEM_VIEW sw_poll_item_view_get_type()
+
+#define SW_POLL_ITEM_VIEW(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), SW_TYPE_POLL_ITEM_VIEW, SwPollItemView))
+
+#define SW_POLL_ITEM_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), SW_TYPE_POLL_ITEM_VIEW, SwPollItemViewClass))
+
+#define SW_IS_POLL_ITEM_VIEW(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), SW_TYPE_POLL_ITEM_VIEW))
+
+#define SW_IS_POLL_ITEM_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), SW_TYPE_POLL_ITEM_VIEW))
+
+#define SW_POLL_ITEM_VIEW_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), SW_TYPE_POLL_ITEM_VIEW, SwPollItemViewClass))
+
+/* How the page wanted is passed in the call */
+typedef enum {
+  /* The page number, counting from first_page */
+  POLL_PAGING_NUMBER,
+  /* The index of the first entry wanted, counting from first_page */
+  POLL_PAGING_INDEX,
+  /* Whatever the last page set with sw_poll_item_view_set_cursor() */
+  POLL_PAGING_CURSOR
+} PollPaging;
+
+/* What a service's views have in common, filled in by its class_init */
+typedef struct {
+  /* Used to label traces */
+  const char *name;
+  /* The call to make, unless get_endpoint is overridden */
+  const char *endpoint;
+  /* The page size, read from the "count" param */
+  guint default_page_size;
+  guint max_page_size;
+  /* The most pages a "pages" param can ask for */
+  guint max_pages;
+  const char *count_param;
+  const char *page_param;
+  PollPaging paging;
+  guint first_page;
+} PollItemViewInfo;
+
+typedef struct {
+  SwItemView parent;
+} SwPollItemView;
+
+typedef struct {
+  SwItemViewClass parent_class;
+
+  const PollItemViewInfo *info;
+
+  /*
+   * The endpoints making up @page, one per @step, returning NULL after the
+   * last.  The length of the page is that of the first step.
+   */
+  const char *(*get_endpoint)   (SwPollItemView *view,
+                                 guint           page,
+                                 guint           step);
+  /* Add anything else the call needs, or return FALSE if it can't be made */
+  gboolean    (*prepare_call)   (SwPollItemView *view,
+                                 RestProxyCall  *call,
+                                 const char     *endpoint);
+  /*
+   * Decode a response, call sw_poll_item_view_mark_parsed(), then build its
+   * items with sw_poll_item_view_add_item(), skipping those
+   * sw_poll_item_view_is_banned(), and return how many entries it held or
+   * -1 if it couldn't be parsed
+   */
+  gint        (*parse_page)     (SwPollItemView *view,
+                                 RestProxyCall  *call,
+                                 const char     *endpoint);
+  void        (*call_failed)    (SwPollItemView *view,
+                                 RestProxyCall  *call,
+                                 const GError   *error);
+  void        (*fetch_finished) (SwPollItemView *view);
+  void        (*user_changed)   (SwPollItemView *view);
+  /* Whether new items are being pushed, so the periodic fetch can be skipped */
+  gboolean    (*is_pushed)      (SwPollItemView *view);
+  /* The view started or stopped polling */
+  void        (*polling_changed) (SwPollItemView *view,
+                                  gboolean        polling);
+  /* Publish the items from elsewhere than the network on a periodic poll,
+   * returning TRUE if so */
+  gboolean    (*fetch_local)    (SwPollItemView *view);
+} SwPollItemViewClass;
+
+GType sw_poll_item_view_get_type (void);
+
+RestProxy  *sw_poll_item_view_get_proxy      (SwPollItemView *view);
+const char *sw_poll_item_view_get_query      (SwPollItemView *view);
+guint       sw_poll_item_view_get_page       (SwPollItemView *view);
+guint       sw_poll_item_view_get_page_size  (SwPollItemView *view);
+guint       sw_poll_item_view_get_n_pages    (SwPollItemView *view);
+guint       sw_poll_item_view_get_generation (SwPollItemView *view);
+gboolean    sw_poll_item_view_is_banned      (SwPollItemView *view,
+                                              const char     *prefix,
+                                              const char     *id);
+void        sw_poll_item_view_mark_parsed    (SwPollItemView *view);
+void        sw_poll_item_view_add_item       (SwPollItemView *view,
+                                              SwItem         *item);
+void        sw_poll_item_view_set_cursor     (SwPollItemView *view,
+                                              const char     *cursor);
+void        sw_poll_item_view_push_items     (SwPollItemView *view,
+                                              GList          *items);
+void        sw_poll_item_view_fetch_soon     (SwPollItemView *view);
+
+G_END_DECLS
+
+#endif /* _SW_POLL_ITEM_VIEW */
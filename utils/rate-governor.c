@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <glib-object.h>
+#include <rest/rest-proxy.h>
+#include <rest/rest-proxy-call.h>
+#include "rate-governor.h"
+
+/*
+ * A token bucket shared by everything that talks to a service through the
+ * same proxy.  The bucket holds an hour's worth of calls and refills
+ * continuously; the rate-limit headers the server sends back correct it,
+ * so the governor never believes there is more budget left than the
+ * server does.
+ *
+ * Polls only take from the part of the bucket above a reserve, and only
+ * while every active view could still get its share of that, so a view
+ * that polls often can't starve the others, and calls a client asked for
+ * can still go out once the polls are being deferred.
+ *
+ * Proxies without a governor attached are never limited.
+ */
+
+#define RATE_GOVERNOR_KEY "sw-rate-governor"
+/* Fraction of the budget kept back for client requests */
+#define RATE_RESERVE 0.25
+
+typedef struct {
+  guint limit;
+  gdouble tokens;
+  gint64 refilled;
+  /* The server said the budget is spent until then */
+  gint64 blocked_until;
+  guint n_views;
+} RateGovernor;
+
+static RateGovernor *
+get_governor (RestProxy *proxy)
+{
+  return g_object_get_data (G_OBJECT (proxy), RATE_GOVERNOR_KEY);
+}
+
+static void
+refill (RateGovernor *governor)
+{
+  gint64 now = time (NULL);
+
+  if (now > governor->refilled) {
+    governor->tokens = MIN (governor->limit,
+                            governor->tokens +
+                            (now - governor->refilled) * governor->limit / 3600.0);
+  }
+  governor->refilled = now;
+}
+
+void
+rate_governor_attach (RestProxy *proxy,
+                      guint      hourly_limit)
+{
+  RateGovernor *governor;
+
+  g_return_if_fail (REST_IS_PROXY (proxy));
+  g_return_if_fail (hourly_limit > 0);
+
+  governor = g_new0 (RateGovernor, 1);
+  governor->limit = hourly_limit;
+  governor->tokens = hourly_limit;
+  governor->refilled = time (NULL);
+
+  g_object_set_data_full (G_OBJECT (proxy), RATE_GOVERNOR_KEY,
+                          governor, g_free);
+}
+
+void
+rate_governor_add_view (RestProxy *proxy)
+{
+  RateGovernor *governor = get_governor (proxy);
+
+  if (governor)
+    governor->n_views++;
+}
+
+void
+rate_governor_remove_view (RestProxy *proxy)
+{
+  RateGovernor *governor = get_governor (proxy);
+
+  if (governor && governor->n_views > 0)
+    governor->n_views--;
+}
+
+gboolean
+rate_governor_acquire (RestProxy    *proxy,
+                       RatePriority  priority,
+                       guint         n_calls)
+{
+  RateGovernor *governor = get_governor (proxy);
+  gdouble available;
+
+  if (governor == NULL)
+    return TRUE;
+
+  if (time (NULL) < governor->blocked_until)
+    return FALSE;
+
+  refill (governor);
+
+  available = governor->tokens;
+  if (priority == RATE_PRIORITY_POLL) {
+    available -= governor->limit * RATE_RESERVE;
+    if (available < (gdouble)n_calls * MAX (governor->n_views, 1)) {
+      g_debug ("Deferring poll, %.0f of %u calls left this hour",
+               governor->tokens, governor->limit);
+      return FALSE;
+    }
+  } else if (available < n_calls) {
+    return FALSE;
+  }
+
+  governor->tokens -= n_calls;
+
+  return TRUE;
+}
+
+void
+rate_governor_update (RestProxy     *proxy,
+                      RestProxyCall *call)
+{
+  RateGovernor *governor = get_governor (proxy);
+  const char *limit, *remaining, *reset;
+  gint64 reset_time;
+
+  if (governor == NULL)
+    return;
+
+  limit = rest_proxy_call_lookup_response_header (call, "X-RateLimit-Limit");
+  remaining = rest_proxy_call_lookup_response_header (call, "X-RateLimit-Remaining");
+  reset = rest_proxy_call_lookup_response_header (call, "X-RateLimit-Reset");
+
+  if (limit && atoi (limit) > 0)
+    governor->limit = atoi (limit);
+
+  if (remaining) {
+    refill (governor);
+    governor->tokens = MIN (governor->tokens, atoi (remaining));
+
+    if (governor->tokens <= 0 && reset) {
+      /* Either a time stamp or a number of seconds */
+      reset_time = g_ascii_strtoll (reset, NULL, 10);
+      if (reset_time < time (NULL) - 24 * 60 * 60)
+        reset_time += time (NULL);
+      governor->blocked_until = reset_time;
+    }
+  }
+
+  /* Throttled without being told for how long: back off for a while */
+  if (rest_proxy_call_get_status_code (call) == 429 && !reset) {
+    governor->tokens = 0;
+    governor->blocked_until = time (NULL) + 15 * 60;
+  }
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rest/rest-proxy.h>
+#include <rest/rest-proxy-call.h>
+
+#ifndef _RATE_GOVERNOR_H_
+#define _RATE_GOVERNOR_H_
+
+typedef enum {
+  /* Periodic refreshes, the first to be deferred */
+  RATE_PRIORITY_POLL,
+  /* Something a client asked for */
+  RATE_PRIORITY_REQUEST
+} RatePriority;
+
+void     rate_governor_attach      (RestProxy     *proxy,
+                                    guint          hourly_limit);
+/* A view of the service started or stopped polling */
+void     rate_governor_add_view    (RestProxy     *proxy);
+void     rate_governor_remove_view (RestProxy     *proxy);
+gboolean rate_governor_acquire     (RestProxy     *proxy,
+                                    RatePriority   priority,
+                                    guint          n_calls);
+void     rate_governor_update      (RestProxy     *proxy,
+                                    RestProxyCall *call);
+
+#endif /* _RATE_GOVERNOR_H_ */
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "utils.h"
+#include "session-store.h"
+
+/*
+ * Login sessions are kept in a key file per service under the user cache
+ * directory, readable only by the user from the moment it is created.  The
+ * account the session belongs to is only stored as a checksum of the user
+ * name with a random salt, so the file never reveals who it belongs to, and
+ * a session is ignored once it has expired or the account has changed.  The
+ * services forget the session themselves when the password changes.
+ */
+
+#define SESSION_GROUP "Session"
+
+static char *
+get_session_filename (const char *service)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "libsocialweb", "sessions", service, NULL);
+}
+
+static char *
+get_account_hash (const char *service,
+                  const char *account,
+                  const char *salt)
+{
+  char *key, *hash;
+
+  key = g_strconcat (salt, ":", service, ":", account, NULL);
+  hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+  g_free (key);
+
+  return hash;
+}
+
+static char *
+make_salt (void)
+{
+  return g_strdup_printf ("%08x%08x%08x%08x",
+                          g_random_int (), g_random_int (),
+                          g_random_int (), g_random_int ());
+}
+
+gboolean
+session_store_lookup (const char *service,
+                      const char *account,
+                      const char *first_key,
+                      char      **first_value,
+                      ...)
+{
+  GKeyFile *keyfile;
+  GPtrArray *found;
+  char *filename, *salt, *hash, *stored;
+  const char *key;
+  char **value;
+  gboolean valid = FALSE;
+  va_list args;
+  guint i;
+
+  g_return_val_if_fail (service && account && first_key, FALSE);
+
+  keyfile = g_key_file_new ();
+  filename = get_session_filename (service);
+
+  if (!g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, NULL))
+    goto done;
+
+  if (g_key_file_get_int64 (keyfile, SESSION_GROUP, "Expires", NULL) <= time (NULL))
+    goto done;
+
+  salt = g_key_file_get_string (keyfile, SESSION_GROUP, "Salt", NULL);
+  if (salt == NULL)
+    goto done;
+
+  hash = get_account_hash (service, account, salt);
+  stored = g_key_file_get_string (keyfile, SESSION_GROUP, "Account", NULL);
+  valid = (g_strcmp0 (hash, stored) == 0);
+  g_free (salt);
+  g_free (hash);
+  g_free (stored);
+
+  if (!valid)
+    goto done;
+
+  /* Only hand out the values if every requested key is present */
+  found = g_ptr_array_new ();
+  va_start (args, first_value);
+  key = first_key;
+  value = first_value;
+  while (key) {
+    *value = g_key_file_get_string (keyfile, SESSION_GROUP, key, NULL);
+    g_ptr_array_add (found, value);
+    if (*value == NULL)
+      valid = FALSE;
+
+    key = va_arg (args, const char *);
+    if (key)
+      value = va_arg (args, char **);
+  }
+  va_end (args);
+
+  if (!valid) {
+    for (i = 0; i < found->len; i++) {
+      value = g_ptr_array_index (found, i);
+      g_free (*value);
+      *value = NULL;
+    }
+  }
+  g_ptr_array_free (found, TRUE);
+
+ done:
+  g_key_file_free (keyfile);
+  g_free (filename);
+
+  return valid;
+}
+
+void
+session_store_save (const char *service,
+                    const char *account,
+                    gint64      expires,
+                    const char *first_key,
+                    const char *first_value,
+                    ...)
+{
+  GKeyFile *keyfile;
+  GError *error = NULL;
+  char *filename, *dirname, *salt, *hash, *data;
+  const char *key, *value;
+  gsize length;
+  va_list args;
+
+  g_return_if_fail (service && account && first_key);
+
+  filename = get_session_filename (service);
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+
+  keyfile = g_key_file_new ();
+
+  salt = make_salt ();
+  hash = get_account_hash (service, account, salt);
+  g_key_file_set_string (keyfile, SESSION_GROUP, "Salt", salt);
+  g_key_file_set_string (keyfile, SESSION_GROUP, "Account", hash);
+  g_key_file_set_int64 (keyfile, SESSION_GROUP, "Expires", expires);
+  g_free (salt);
+  g_free (hash);
+
+  va_start (args, first_value);
+  key = first_key;
+  value = first_value;
+  while (key) {
+    if (value)
+      g_key_file_set_string (keyfile, SESSION_GROUP, key, value);
+
+    key = va_arg (args, const char *);
+    if (key)
+      value = va_arg (args, const char *);
+  }
+  va_end (args);
+
+  data = g_key_file_to_data (keyfile, &length, NULL);
+
+  if (!write_private_file (filename, data, length, &error)) {
+    g_message ("Error: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+  g_key_file_free (keyfile);
+  g_free (dirname);
+  g_free (filename);
+}
+
+void
+session_store_forget (const char *service)
+{
+  char *filename;
+
+  g_return_if_fail (service);
+
+  filename = get_session_filename (service);
+  g_unlink (filename);
+  g_free (filename);
+}
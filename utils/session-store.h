@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#ifndef _SESSION_STORE_H_
+#define _SESSION_STORE_H_
+
+gboolean session_store_lookup (const char *service,
+                               const char *account,
+                               const char *first_key,
+                               char      **first_value,
+                               ...) G_GNUC_NULL_TERMINATED;
+void     session_store_save   (const char *service,
+                               const char *account,
+                               gint64      expires,
+                               const char *first_key,
+                               const char *first_value,
+                               ...) G_GNUC_NULL_TERMINATED;
+void     session_store_forget (const char *service);
+
+#endif /* _SESSION_STORE_H_ */
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include "trace.h"
+
+/*
+ * Request tracing is enabled by setting SW_TRACE in the environment of the
+ * daemon.  Every finished refresh is logged as a single key=value record with
+ * the time spent in each stage, and the last TRACE_RING_SIZE spans are kept in
+ * a ring buffer which is summarised per service every time it wraps.
+ */
+
+#define TRACE_RING_SIZE 64
+
+struct _RequestTrace {
+  const char *service;
+  const char *query;
+  gint64 start;
+  gint64 stamps[TRACE_N_STAGES];
+};
+
+typedef struct {
+  const char *service;
+  const char *query;
+  gboolean aborted;
+  /* Microseconds spent in each stage, or -1 if the stage was not reached */
+  gint64 durations[TRACE_N_STAGES];
+} TraceSpan;
+
+static const char *stage_names[TRACE_N_STAGES] = {
+  "request",
+  "response",
+  "parse",
+  "items",
+  "publish",
+  "cache"
+};
+
+static TraceSpan ring[TRACE_RING_SIZE];
+static guint ring_next = 0;
+static guint ring_length = 0;
+
+static gboolean
+trace_enabled (void)
+{
+  static gint enabled = -1;
+
+  if (enabled == -1)
+    enabled = (g_getenv ("SW_TRACE") != NULL);
+
+  return enabled;
+}
+
+RequestTrace *
+request_trace_begin (const char *service,
+                     const char *query)
+{
+  RequestTrace *trace;
+
+  if (!trace_enabled ())
+    return NULL;
+
+  trace = g_slice_new0 (RequestTrace);
+  trace->service = g_intern_string (service);
+  trace->query = g_intern_string (query);
+  trace->start = g_get_monotonic_time ();
+
+  return trace;
+}
+
+void
+request_trace_mark (RequestTrace *trace,
+                    TraceStage    stage)
+{
+  g_return_if_fail (stage < TRACE_N_STAGES);
+
+  if (trace == NULL)
+    return;
+
+  trace->stamps[stage] = g_get_monotonic_time ();
+}
+
+static void
+record_span (RequestTrace *trace,
+             const char   *reason)
+{
+  TraceSpan *span;
+  GString *record;
+  gint64 previous, total = 0;
+  gint i;
+
+  span = &ring[ring_next];
+  span->service = trace->service;
+  span->query = trace->query;
+  span->aborted = (reason != NULL);
+
+  record = g_string_new (NULL);
+  g_string_append_printf (record, "span service=%s query=%s",
+                          trace->service, trace->query);
+
+  previous = trace->start;
+  for (i = 0; i < TRACE_N_STAGES; i++) {
+    if (trace->stamps[i] >= previous) {
+      span->durations[i] = trace->stamps[i] - previous;
+      previous = trace->stamps[i];
+      total += span->durations[i];
+      g_string_append_printf (record, " %s=%.1fms",
+                              stage_names[i], span->durations[i] / 1000.0);
+    } else {
+      span->durations[i] = -1;
+      g_string_append_printf (record, " %s=-", stage_names[i]);
+    }
+  }
+
+  g_string_append_printf (record, " total=%.1fms", total / 1000.0);
+  if (reason)
+    g_string_append_printf (record, " aborted=\"%s\"", reason);
+
+  g_message ("%s", record->str);
+  g_string_free (record, TRUE);
+
+  ring_next = (ring_next + 1) % TRACE_RING_SIZE;
+  if (ring_length < TRACE_RING_SIZE)
+    ring_length++;
+
+  if (ring_next == 0)
+    request_trace_dump ();
+}
+
+/*
+ * Record the span and free @trace.
+ */
+void
+request_trace_finish (RequestTrace *trace)
+{
+  if (trace == NULL)
+    return;
+
+  record_span (trace, NULL);
+  g_slice_free (RequestTrace, trace);
+}
+
+/*
+ * Record the span as failed with @reason and free @trace.
+ */
+void
+request_trace_abort (RequestTrace *trace,
+                     const char   *reason)
+{
+  if (trace == NULL)
+    return;
+
+  record_span (trace, reason ? reason : "unknown");
+  g_slice_free (RequestTrace, trace);
+}
+
+/*
+ * Log the mean and worst time spent in each stage for every service in the
+ * ring buffer, together with the stage that dominates the worst case.
+ */
+void
+request_trace_dump (void)
+{
+  const char *done[TRACE_RING_SIZE];
+  guint n_done = 0, i, j;
+  gint s;
+
+  for (i = 0; i < ring_length; i++) {
+    const char *service = ring[i].service;
+    gint64 sum[TRACE_N_STAGES] = { 0 }, max[TRACE_N_STAGES] = { 0 };
+    guint count[TRACE_N_STAGES] = { 0 };
+    guint spans = 0, aborted = 0;
+    gint worst = 0;
+    GString *record;
+
+    for (j = 0; j < n_done; j++)
+      if (done[j] == service)
+        break;
+    if (j < n_done)
+      continue;
+    done[n_done++] = service;
+
+    for (j = i; j < ring_length; j++) {
+      if (ring[j].service != service)
+        continue;
+
+      spans++;
+      if (ring[j].aborted)
+        aborted++;
+
+      for (s = 0; s < TRACE_N_STAGES; s++) {
+        if (ring[j].durations[s] < 0)
+          continue;
+        sum[s] += ring[j].durations[s];
+        count[s]++;
+        if (ring[j].durations[s] > max[s])
+          max[s] = ring[j].durations[s];
+      }
+    }
+
+    record = g_string_new (NULL);
+    g_string_append_printf (record, "summary service=%s spans=%u aborted=%u",
+                            service, spans, aborted);
+
+    for (s = 0; s < TRACE_N_STAGES; s++) {
+      if (count[s] == 0) {
+        g_string_append_printf (record, " %s=-", stage_names[s]);
+        continue;
+      }
+
+      g_string_append_printf (record, " %s=%.1f/%.1fms",
+                              stage_names[s],
+                              sum[s] / count[s] / 1000.0,
+                              max[s] / 1000.0);
+      if (max[s] > max[worst])
+        worst = s;
+    }
+
+    g_string_append_printf (record, " dominant=%s", stage_names[worst]);
+
+    g_message ("%s", record->str);
+    g_string_free (record, TRUE);
+  }
+}
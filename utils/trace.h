@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2010 Novell Inc.
+ *
+ * Author: Gary Ching-Pang Lin <glin@novell.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * The stages every item view refresh goes through, in order.  Each stage is
+ * stamped with the monotonic clock when it completes.
+ */
+typedef enum {
+  TRACE_STAGE_REQUEST,  /* the call has been issued */
+  TRACE_STAGE_RESPONSE, /* the HTTP response has arrived */
+  TRACE_STAGE_PARSE,    /* the payload has been parsed */
+  TRACE_STAGE_ITEMS,    /* the items have been built */
+  TRACE_STAGE_PUBLISH,  /* the set has been handed to the view */
+  TRACE_STAGE_CACHE,    /* the set has been written to the cache */
+  TRACE_N_STAGES
+} TraceStage;
+
+typedef struct _RequestTrace RequestTrace;
+
+RequestTrace *request_trace_begin  (const char   *service,
+                                    const char   *query);
+void          request_trace_mark   (RequestTrace *trace,
+                                    TraceStage    stage);
+void          request_trace_finish (RequestTrace *trace);
+void          request_trace_abort  (RequestTrace *trace,
+                                    const char   *reason);
+void          request_trace_dump   (void);
+
+#endif /* _TRACE_H_ */
@@ -18,7 +18,10 @@
  */
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <libsoup/soup.h>
 #include "utils.h"
 
@@ -155,3 +158,86 @@ xml_get_child_node_value (RestXmlNode *node,
   else
     return NULL;
 }
+
+/*
+ * Look up @key in the view @params and return it as a number between 1 and
+ * @max, or @fallback if it isn't set or isn't a positive number.
+ */
+guint
+get_uint_param (GHashTable *params,
+                const char *key,
+                guint       fallback,
+                guint       max)
+{
+  const char *value;
+  char *end;
+  guint64 n;
+
+  g_assert (key);
+
+  if (params == NULL)
+    return fallback;
+
+  value = g_hash_table_lookup (params, key);
+  if (value == NULL)
+    return fallback;
+
+  n = g_ascii_strtoull (value, &end, 10);
+  if (end == value || *end != '\0' || n == 0)
+    return fallback;
+
+  return MIN (n, max);
+}
+
+/*
+ * Write @data to a new file that is never readable by anyone else, and
+ * move it over @filename so a reader never sees half of it.
+ */
+gboolean
+write_private_file (const char  *filename,
+                    const char  *data,
+                    gsize        length,
+                    GError     **error)
+{
+  char *tmpname;
+  gssize written;
+  int fd, saved_errno;
+
+  tmpname = g_strconcat (filename, ".XXXXXX", NULL);
+
+  /* g_mkstemp() creates the file with mode 0600 */
+  fd = g_mkstemp (tmpname);
+  if (fd < 0) {
+    saved_errno = errno;
+    goto error;
+  }
+
+  while (length > 0) {
+    written = write (fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      saved_errno = errno;
+      close (fd);
+      g_unlink (tmpname);
+      goto error;
+    }
+    data += written;
+    length -= written;
+  }
+
+  if (close (fd) < 0 || g_rename (tmpname, filename) < 0) {
+    saved_errno = errno;
+    g_unlink (tmpname);
+    goto error;
+  }
+
+  g_free (tmpname);
+  return TRUE;
+
+ error:
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+               "Failed to write %s: %s", filename, g_strerror (saved_errno));
+  g_free (tmpname);
+  return FALSE;
+}
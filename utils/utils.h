@@ -32,4 +32,12 @@ RestXmlNode *xml_node_from_call       (RestProxyCall *call,
                                        const char    *name);
 char        *xml_get_child_node_value (RestXmlNode   *node,
                                        const char    *name);
+guint        get_uint_param           (GHashTable    *params,
+                                       const char    *key,
+                                       guint          fallback,
+                                       guint          max);
+gboolean     write_private_file       (const char    *filename,
+                                       const char    *data,
+                                       gsize          length,
+                                       GError       **error);
 #endif /* _UTILS_H_ */